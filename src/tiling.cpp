@@ -0,0 +1,685 @@
+#include "tiling.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace wmtiler {
+
+std::unordered_map<Window, WindowState> g_windowStates;
+std::map<unsigned long, std::vector<Window>> g_desktopClients;
+std::map<unsigned long, std::vector<Window>> g_windowOrder;
+std::vector<Output> g_outputs;
+LayoutCache g_layoutCache;
+std::map<std::pair<unsigned long, size_t>, DesktopSplits> g_desktopSplits;
+
+namespace {
+
+constexpr int kWeightStep = 20;
+constexpr int kMinWeight = 20;
+constexpr int kMaxWeight = 400;
+
+// Fixed-capacity vector stored inline, for scratch data on the layout path.
+template <typename T, size_t Capacity>
+class FixedVector {
+public:
+    constexpr FixedVector() = default;
+
+    constexpr void push_back(const T& value) { items_[size_++] = value; }
+    constexpr bool full() const { return size_ == Capacity; }
+    constexpr size_t size() const { return size_; }
+    constexpr T& back() { return items_[size_ - 1]; }
+    constexpr const T& operator[](size_t index) const { return items_[index]; }
+
+private:
+    std::array<T, Capacity> items_{};
+    size_t size_ = 0;
+};
+
+// Size of slot `index` when `total` pixels are split across `slots`; the
+// remainder goes to the leading slots.
+int distribute(int total, int slots, int index) {
+    int base = total / slots;
+    int remainder = total - base * slots;
+    return base + (index < remainder ? 1 : 0);
+}
+
+constexpr size_t kMaxGridRows = 64;
+using RowPlan = FixedVector<int, kMaxGridRows>;
+
+// Grid packing policies: each maps a window count to the number of windows
+// per row. Counts too large for kMaxGridRows rows share the last row.
+
+// Rows of MaxColumns windows, the remainder in the last row (7 -> 3,3,1).
+template <int MaxColumns>
+struct FillRows {
+    static constexpr RowPlan rows(int count) {
+        RowPlan plan;
+        int remaining = count;
+        while (remaining > 0) {
+            if (plan.full()) {
+                plan.back() += remaining;
+                break;
+            }
+            int cols = std::min(remaining, MaxColumns);
+            plan.push_back(cols);
+            remaining -= cols;
+        }
+        return plan;
+    }
+};
+
+// As few rows as MaxColumns allows, with the windows spread evenly and the
+// shorter rows on top (5 -> 2,3; 7 -> 2,2,3).
+template <int MaxColumns>
+struct BalancedRows {
+    static constexpr RowPlan rows(int count) {
+        RowPlan plan;
+        if (count <= 0) {
+            return plan;
+        }
+        int rowCount = std::min((count + MaxColumns - 1) / MaxColumns, static_cast<int>(kMaxGridRows));
+        int base = count / rowCount;
+        int longer = count % rowCount;
+        for (int row = 0; row < rowCount; ++row) {
+            plan.push_back(base + (row >= rowCount - longer ? 1 : 0));
+        }
+        return plan;
+    }
+};
+
+// The original wmtiler grid: balanced while two rows suffice, filled after.
+template <int MaxColumns>
+struct ClassicRows {
+    static constexpr RowPlan rows(int count) {
+        return count <= 2 * MaxColumns ? BalancedRows<MaxColumns>::rows(count)
+                                       : FillRows<MaxColumns>::rows(count);
+    }
+};
+
+// Row partitions for every window count up to kMaxTableWindows, generated at
+// compile time so the grid engine only indexes a table.
+constexpr int kMaxTableWindows = 64;
+
+template <typename Policy>
+constexpr std::array<RowPlan, kMaxTableWindows + 1> makeRowTable() {
+    std::array<RowPlan, kMaxTableWindows + 1> table{};
+    for (int count = 0; count <= kMaxTableWindows; ++count) {
+        table[count] = Policy::rows(count);
+    }
+    return table;
+}
+
+template <typename Policy>
+constexpr auto kRowTable = makeRowTable<Policy>();
+
+static_assert(kRowTable<ClassicRows<3>>[5].size() == 2 && kRowTable<ClassicRows<3>>[5][0] == 2);
+static_assert(kRowTable<ClassicRows<3>>[7].size() == 3 && kRowTable<ClassicRows<3>>[7][2] == 1);
+static_assert(kRowTable<BalancedRows<3>>[7].size() == 3 && kRowTable<BalancedRows<3>>[7][2] == 3);
+
+// Size of slot `index` when `total` pixels are split across `slots` in
+// proportion to `weights`. Empty or uniform weights fall back to distribute()
+// so unweighted layouts stay pixel-identical.
+int weightedShare(int total, std::span<const int> weights, int slots, int index) {
+    if (weights.empty() ||
+        std::all_of(weights.begin(), weights.end(), [&](int w) { return w == weights[0]; })) {
+        return distribute(total, slots, index);
+    }
+    long long sum = 0;
+    long long before = 0;
+    for (int i = 0; i < slots; ++i) {
+        if (i == index) {
+            before = sum;
+        }
+        sum += weights[i];
+    }
+    long long start = total * before / sum;
+    long long end = total * (before + weights[index]) / sum;
+    return static_cast<int>(end - start);
+}
+
+std::span<const int> weightsFor(std::span<const int> weights, size_t first, size_t count) {
+    return weights.empty() ? weights : weights.subspan(first, count);
+}
+
+// Every layout engine fills `out` with one rect per window, splitting space in
+// proportion to the per-slot `weights` (empty means equal shares); the caller
+// owns the storage, so computing a layout never allocates. Each engine also
+// has a relayout function that, after the weight of one slot changed, updates
+// only the rects that depend on it and returns their [first, last) range.
+
+// The part of `screen` left for windows once the desktop's margins are off.
+Rect insetByMargins(const Rect& screen, const DesktopLayout& layout) {
+    return Rect{screen.x + layout.marginLeft,
+                screen.y + layout.marginTop,
+                std::max(0, screen.width - layout.marginLeft - layout.marginRight),
+                std::max(0, screen.height - layout.marginTop - layout.marginBottom)};
+}
+
+void layoutGridRow(const DesktopLayout& layout,
+                   const Rect& usable,
+                   std::span<const int> weights,
+                   size_t first,
+                   int cols,
+                   int y,
+                   int height,
+                   std::span<Rect> out) {
+    int rowWidth = std::max(0, usable.width - layout.gap * (cols - 1));
+    auto rowWeights = weightsFor(weights, first, static_cast<size_t>(cols));
+    int x = usable.x;
+    for (int col = 0; col < cols; ++col) {
+        int width = weightedShare(rowWidth, rowWeights, cols, col);
+        out[first + static_cast<size_t>(col)] = Rect{x, y, width, height};
+        x += width + layout.gap;
+    }
+}
+
+template <typename Policy>
+const RowPlan& rowPlanFor(int count, RowPlan& overflow) {
+    if (count > kMaxTableWindows) [[unlikely]] {
+        overflow = Policy::rows(count);
+        return overflow;
+    }
+    return kRowTable<Policy>[count];
+}
+
+template <typename Policy>
+void computeGridPositions(const Rect& screen,
+                          const DesktopLayout& layout,
+                          std::span<const int> weights,
+                          std::span<Rect> out) {
+    int count = static_cast<int>(out.size());
+    if (count == 0) {
+        return;
+    }
+    RowPlan overflow;
+    const RowPlan& rows = rowPlanFor<Policy>(count, overflow);
+    int rowCount = static_cast<int>(rows.size());
+    Rect usable = insetByMargins(screen, layout);
+    int usableHeight = usable.height - layout.gap * (rowCount - 1);
+    if (usableHeight < 0) {
+        usableHeight = 0;
+    }
+
+    int placed = 0;
+    int y = usable.y;
+    for (int rowIdx = 0; rowIdx < rowCount && placed < count; ++rowIdx) {
+        int rowHeight = distribute(usableHeight, rowCount, rowIdx);
+        int cols = std::min(rows[rowIdx], count - placed);
+        layoutGridRow(layout, usable, weights, placed, cols, y, rowHeight, out);
+        placed += cols;
+        y += rowHeight + layout.gap;
+    }
+}
+
+// Weights only split a row horizontally, so only the slot's row changes.
+template <typename Policy>
+std::pair<size_t, size_t> relayoutGrid(const Rect& screen,
+                                       const DesktopLayout& layout,
+                                       std::span<const int> weights,
+                                       size_t slot,
+                                       std::span<Rect> out) {
+    int count = static_cast<int>(out.size());
+    RowPlan overflow;
+    const RowPlan& rows = rowPlanFor<Policy>(count, overflow);
+    size_t first = 0;
+    for (size_t rowIdx = 0; rowIdx < rows.size(); ++rowIdx) {
+        int cols = std::min(rows[rowIdx], count - static_cast<int>(first));
+        if (slot < first + static_cast<size_t>(cols)) {
+            const Rect& rowRect = out[first];
+            layoutGridRow(layout, insetByMargins(screen, layout), weights, first, cols, rowRect.y,
+                          rowRect.height, out);
+            return {first, first + static_cast<size_t>(cols)};
+        }
+        first += static_cast<size_t>(cols);
+    }
+    return {0, 0};
+}
+
+// A slot alone in its row has nothing to trade width with.
+template <typename Policy>
+bool gridSharesSpace(size_t count, size_t slot) {
+    RowPlan overflow;
+    const RowPlan& rows = rowPlanFor<Policy>(static_cast<int>(count), overflow);
+    size_t first = 0;
+    for (size_t rowIdx = 0; rowIdx < rows.size(); ++rowIdx) {
+        size_t last = std::min(count, first + static_cast<size_t>(rows[rowIdx]));
+        if (slot < last) {
+            return last - first > 1;
+        }
+        first = last;
+    }
+    return false;
+}
+
+constexpr int kMasterPercent = 55;
+
+void layoutStackColumn(const DesktopLayout& layout,
+                       std::span<const int> weights,
+                       const Rect& usable,
+                       int x,
+                       int width,
+                       std::span<Rect> out) {
+    int stackCount = static_cast<int>(out.size()) - 1;
+    int stackHeight = std::max(0, usable.height - layout.gap * (stackCount - 1));
+    auto stackWeights = weightsFor(weights, 1, static_cast<size_t>(stackCount));
+    int y = usable.y;
+    for (int i = 0; i < stackCount; ++i) {
+        int height = weightedShare(stackHeight, stackWeights, stackCount, i);
+        out[static_cast<size_t>(i) + 1] = Rect{x, y, width, height};
+        y += height + layout.gap;
+    }
+}
+
+// One large master window on the left, the rest stacked vertically on the
+// right. The master's weight scales the master column; the others split the
+// stack.
+void computeMasterStackPositions(const Rect& screen,
+                                 const DesktopLayout& layout,
+                                 std::span<const int> weights,
+                                 std::span<Rect> out) {
+    int count = static_cast<int>(out.size());
+    if (count == 0) {
+        return;
+    }
+    Rect usable = insetByMargins(screen, layout);
+    if (count == 1) {
+        out[0] = usable;
+        return;
+    }
+    int columnsWidth = std::max(0, usable.width - layout.gap);
+    long long master = kMasterPercent * static_cast<long long>(weights.empty() ? kDefaultWeight : weights[0]);
+    long long stack = (100 - kMasterPercent) * static_cast<long long>(kDefaultWeight);
+    int masterWidth = static_cast<int>(columnsWidth * master / (master + stack));
+    int stackWidth = columnsWidth - masterWidth;
+    out[0] = Rect{usable.x, usable.y, masterWidth, usable.height};
+    layoutStackColumn(layout, weights, usable, usable.x + masterWidth + layout.gap, stackWidth, out);
+}
+
+// The master's weight moves the column split; any other slot only changes the
+// stack column.
+std::pair<size_t, size_t> relayoutMasterStack(const Rect& screen,
+                                              const DesktopLayout& layout,
+                                              std::span<const int> weights,
+                                              size_t slot,
+                                              std::span<Rect> out) {
+    if (slot == 0 || out.size() < 2) {
+        computeMasterStackPositions(screen, layout, weights, out);
+        return {0, out.size()};
+    }
+    layoutStackColumn(layout, weights, insetByMargins(screen, layout), out[1].x, out[1].width, out);
+    return {1, out.size()};
+}
+
+bool masterStackSharesSpace(size_t count, size_t slot) {
+    return count > 1 && (slot == 0 || count > 2);
+}
+
+// Binary space partition: starting at slot `first`, each window takes a share
+// of the free area (half for the default weight), splitting across the longer
+// side, and the last window takes the rest. Iterative and allocation-free.
+void dwindleFrom(size_t first, Rect area, int gap, std::span<const int> weights, std::span<Rect> out) {
+    for (size_t i = first; i < out.size(); ++i) {
+        if (i + 1 == out.size()) {
+            out[i] = area;
+            break;
+        }
+        long long weight = weights.empty() ? kDefaultWeight : weights[i];
+        if (area.width >= area.height) {
+            int split = static_cast<int>(std::max(0, area.width - gap) * weight / (weight + kDefaultWeight));
+            out[i] = Rect{area.x, area.y, split, area.height};
+            int consumed = std::min(area.width, split + gap);
+            area.x += consumed;
+            area.width -= consumed;
+        } else {
+            int split = static_cast<int>(std::max(0, area.height - gap) * weight / (weight + kDefaultWeight));
+            out[i] = Rect{area.x, area.y, area.width, split};
+            int consumed = std::min(area.height, split + gap);
+            area.y += consumed;
+            area.height -= consumed;
+        }
+    }
+}
+
+void computeDwindlePositions(const Rect& screen,
+                             const DesktopLayout& layout,
+                             std::span<const int> weights,
+                             std::span<Rect> out) {
+    dwindleFrom(0, insetByMargins(screen, layout), layout.gap, weights, out);
+}
+
+// A slot's split only affects itself and the slots nested inside the area it
+// leaves free, whose bounding box is that area.
+std::pair<size_t, size_t> relayoutDwindle(const Rect&,
+                                          const DesktopLayout& layout,
+                                          std::span<const int> weights,
+                                          size_t slot,
+                                          std::span<Rect> out) {
+    Rect area = out[slot];
+    for (size_t i = slot + 1; i < out.size(); ++i) {
+        int right = std::max(area.x + area.width, out[i].x + out[i].width);
+        int bottom = std::max(area.y + area.height, out[i].y + out[i].height);
+        area.x = std::min(area.x, out[i].x);
+        area.y = std::min(area.y, out[i].y);
+        area.width = right - area.x;
+        area.height = bottom - area.y;
+    }
+    dwindleFrom(slot, area, layout.gap, weights, out);
+    return {slot, out.size()};
+}
+
+// The last slot always takes whatever area is left.
+bool dwindleSharesSpace(size_t count, size_t slot) {
+    return slot + 1 < count;
+}
+
+bool isTileable(const WindowState& state) {
+    return !state.dockOrDesktop && state.mapped && !state.hidden;
+}
+
+// The output containing the window's center: where we last placed it, or
+// where it is now if we never did.
+size_t outputOf(Window win) {
+    auto it = g_windowStates.find(win);
+    if (g_outputs.size() < 2 || it == g_windowStates.end()) {
+        return 0;
+    }
+    const auto& state = it->second;
+    const Rect& rect = state.requested ? *state.requested : state.geometry;
+    int centerX = rect.x + rect.width / 2;
+    int centerY = rect.y + rect.height / 2;
+    for (size_t i = 0; i < g_outputs.size(); ++i) {
+        const Rect& area = g_outputs[i].area;
+        if (centerX >= area.x && centerX < area.x + area.width && centerY >= area.y &&
+            centerY < area.y + area.height) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+// Largest size within `available` that the client accepts: base plus a whole
+// number of increments, at least the minimum and at most the maximum.
+int snapToIncrement(int available, int minimum, int maximum, int base, int increment) {
+    int size = std::max(available, minimum);
+    if (maximum > 0) {
+        size = std::min(size, std::max(maximum, minimum));
+    }
+    if (size > base) {
+        size = base + (size - base) / increment * increment;
+    }
+    if (size < minimum) {
+        size += (minimum - size + increment - 1) / increment * increment;
+    }
+    return std::max(size, 1);
+}
+
+Rect constrainToHints(const Rect& cell, const SizeHints& hints) {
+    int width = snapToIncrement(cell.width, hints.minWidth, hints.maxWidth, hints.baseWidth, hints.widthInc);
+    int height = snapToIncrement(cell.height, hints.minHeight, hints.maxHeight, hints.baseHeight, hints.heightInc);
+    // ICCCM applies the aspect ratio to the size beyond an explicit base
+    // size; the minimum size does not stand in for it here.
+    int aspectBaseWidth = hints.hasBase ? hints.baseWidth : 0;
+    int aspectBaseHeight = hints.hasBase ? hints.baseHeight : 0;
+    long long aspectWidth = width - aspectBaseWidth;
+    long long aspectHeight = height - aspectBaseHeight;
+    if (hints.minAspectX > 0 && aspectWidth > 0 && aspectHeight > 0) {
+        // Too narrow: lose height. Too wide: lose width. Either way re-snap
+        // the shrunk side so it stays on an increment.
+        if (aspectWidth * hints.minAspectY < aspectHeight * hints.minAspectX) {
+            int target = aspectBaseHeight + static_cast<int>(aspectWidth * hints.minAspectY / hints.minAspectX);
+            height = snapToIncrement(target, 0, 0, hints.baseHeight, hints.heightInc);
+        } else if (aspectWidth * hints.maxAspectY > aspectHeight * hints.maxAspectX) {
+            int target = aspectBaseWidth + static_cast<int>(aspectHeight * hints.maxAspectX / hints.maxAspectY);
+            width = snapToIncrement(target, 0, 0, hints.baseWidth, hints.widthInc);
+        }
+    }
+    return Rect{cell.x, cell.y, width, height};
+}
+
+} // namespace
+
+constexpr std::array<LayoutEngineInfo, 4> kLayoutEngines = {{
+    {LayoutEngine::Grid,
+     "grid",
+     computeGridPositions<ClassicRows<3>>,
+     relayoutGrid<ClassicRows<3>>,
+     gridSharesSpace<ClassicRows<3>>},
+    {LayoutEngine::GridBalanced,
+     "grid-balanced",
+     computeGridPositions<BalancedRows<3>>,
+     relayoutGrid<BalancedRows<3>>,
+     gridSharesSpace<BalancedRows<3>>},
+    {LayoutEngine::MasterStack,
+     "master-stack",
+     computeMasterStackPositions,
+     relayoutMasterStack,
+     masterStackSharesSpace},
+    {LayoutEngine::Dwindle, "dwindle", computeDwindlePositions, relayoutDwindle, dwindleSharesSpace},
+}};
+
+static_assert([] {
+    for (size_t i = 0; i < kLayoutEngines.size(); ++i) {
+        if (static_cast<size_t>(kLayoutEngines[i].engine) != i) {
+            return false;
+        }
+    }
+    return true;
+}(), "kLayoutEngines must be indexed by LayoutEngine");
+
+std::optional<LayoutEngine> parseLayoutEngine(const std::string& name) {
+    for (const auto& info : kLayoutEngines) {
+        if (name == info.name) {
+            return info.engine;
+        }
+    }
+    return std::nullopt;
+}
+
+const LayoutEngineInfo& engineFor(const DesktopLayout& layout) {
+    return kLayoutEngines[static_cast<size_t>(layout.engine)];
+}
+
+std::span<const Rect> LayoutCache::get(int count, const Rect& screen, const DesktopLayout& layout) {
+    Entry* victim = &entries_[0];
+    for (auto& entry : entries_) {
+        if (entry.lastUse != 0 && entry.count == count && entry.screen == screen &&
+            entry.layout == layout) {
+            entry.lastUse = ++clock_;
+            ++hits_;
+            return {entry.rects.data(), static_cast<size_t>(count)};
+        }
+        if (entry.lastUse < victim->lastUse) {
+            victim = &entry;
+        }
+    }
+    victim->count = count;
+    victim->screen = screen;
+    victim->layout = layout;
+    if (victim->rects.size() < static_cast<size_t>(count)) {
+        victim->rects.resize(static_cast<size_t>(count));
+    }
+    std::span<Rect> rects(victim->rects.data(), static_cast<size_t>(count));
+    engineFor(layout).compute(screen, layout, {}, rects);
+    victim->lastUse = ++clock_;
+    return rects;
+}
+
+bool hasCustomWeights(const DesktopSplits& splits, size_t count) {
+    size_t limit = std::min(count, splits.weights.size());
+    return std::any_of(splits.weights.begin(), splits.weights.begin() + static_cast<std::ptrdiff_t>(limit),
+                       [](int weight) { return weight != kDefaultWeight; });
+}
+
+std::span<Rect> splitPositions(DesktopSplits& splits,
+                               size_t count,
+                               const Rect& screen,
+                               const DesktopLayout& layout) {
+    if (splits.weights.size() < count) {
+        splits.weights.resize(count, kDefaultWeight);
+    }
+    if (!splits.valid || splits.rects.size() != count || !(splits.screen == screen) ||
+        !(splits.layout == layout)) {
+        splits.rects.resize(count);
+        engineFor(layout).compute(screen, layout,
+                                  std::span<const int>(splits.weights.data(), count), splits.rects);
+        splits.screen = screen;
+        splits.layout = layout;
+        splits.valid = true;
+    }
+    return splits.rects;
+}
+
+// Fills `out` with the tileable windows of the desktop in the order
+// remembered for it, appending windows seen for the first time. Windows that
+// are only temporarily filtered out (hidden, not yet mapped) keep their slot;
+// closed ones and ones that moved to another desktop are forgotten. Only the
+// capacity of `out` and of the stored order is used, so a steady-state call
+// does not allocate.
+void orderedWindows(unsigned long desktop, std::vector<Window>& out) {
+    out.clear();
+    auto& stored = g_windowOrder[desktop];
+    stored.erase(std::remove_if(stored.begin(),
+                                stored.end(),
+                                [desktop](Window win) {
+                                    auto it = g_windowStates.find(win);
+                                    return it == g_windowStates.end() || !it->second.listed ||
+                                           it->second.desktop != desktop;
+                                }),
+                 stored.end());
+    auto members = g_desktopClients.find(desktop);
+    if (members != g_desktopClients.end()) {
+        for (auto win : members->second) {
+            auto it = g_windowStates.find(win);
+            if (it != g_windowStates.end() && isTileable(it->second) &&
+                std::find(stored.begin(), stored.end(), win) == stored.end()) {
+                stored.push_back(win);
+            }
+        }
+    }
+    for (auto win : stored) {
+        auto it = g_windowStates.find(win);
+        if (it != g_windowStates.end() && isTileable(it->second)) {
+            out.push_back(win);
+        }
+    }
+}
+
+void windowsOnOutput(const std::vector<Window>& ordered, size_t output, std::vector<Window>& out) {
+    out.clear();
+    for (auto win : ordered) {
+        if (outputOf(win) == output) {
+            out.push_back(win);
+        }
+    }
+}
+
+// Where the client window itself ends up when its frame fills `outer`.
+Rect clientRect(const Rect& outer, const FrameExtents& frame) {
+    return Rect{outer.x + frame.left,
+                outer.y + frame.top,
+                std::max(1, outer.width - frame.left - frame.right),
+                std::max(1, outer.height - frame.top - frame.bottom)};
+}
+
+// Slack goes to the next cell in the same row/column; a trailing cell's slack
+// stays empty.
+bool fitToSizeHints(std::span<const Rect> positions,
+                    const std::vector<Window>& windows,
+                    int gap,
+                    std::span<Rect> out) {
+    std::copy(positions.begin(), positions.end(), out.begin());
+    bool anyHints = false;
+    for (size_t i = 0; i < out.size(); ++i) {
+        auto it = g_windowStates.find(windows[i]);
+        if (it == g_windowStates.end() || !it->second.sizeHints) {
+            continue;
+        }
+        anyHints = true;
+        // Hints constrain the client; the frame keeps its size around it.
+        Rect cell = out[i];
+        const auto& frame = it->second.frame;
+        Rect content = constrainToHints(clientRect(cell, frame), *it->second.sizeHints);
+        Rect snapped{cell.x,
+                     cell.y,
+                     content.width + frame.left + frame.right,
+                     content.height + frame.top + frame.bottom};
+        int spareWidth = cell.width - snapped.width;
+        int spareHeight = cell.height - snapped.height;
+        for (size_t j = i + 1; j < out.size(); ++j) {
+            Rect& next = out[j];
+            if (spareWidth != 0 && next.x == cell.x + cell.width + gap && next.y == cell.y &&
+                next.height == cell.height) {
+                next.x -= spareWidth;
+                next.width = std::max(1, next.width + spareWidth);
+                spareWidth = 0;
+            } else if (spareHeight != 0 && next.y == cell.y + cell.height + gap && next.x == cell.x &&
+                       next.width == cell.width) {
+                next.y -= spareHeight;
+                next.height = std::max(1, next.height + spareHeight);
+                spareHeight = 0;
+            }
+        }
+        out[i] = snapped;
+    }
+    return anyHints;
+}
+
+bool beginCommandBatch(unsigned long desktop, Window active, CommandBatch& batch) {
+    orderedWindows(desktop, batch.ordered);
+    batch.desktop = desktop;
+    // Each output is laid out on its own, so only its windows take part.
+    batch.output = outputOf(active);
+    windowsOnOutput(batch.ordered, batch.output, batch.windows);
+    auto it = std::find(batch.windows.begin(), batch.windows.end(), active);
+    if (it == batch.windows.end()) {
+        return false;
+    }
+    batch.slot = static_cast<size_t>(std::distance(batch.windows.begin(), it));
+    const auto& weights = g_desktopSplits[{desktop, batch.output}].weights;
+    batch.weights.assign(weights.begin(),
+                         weights.begin() + static_cast<std::ptrdiff_t>(std::min(weights.size(), batch.windows.size())));
+    batch.weights.resize(batch.windows.size(), kDefaultWeight);
+    batch.reordered = false;
+    return true;
+}
+
+// Applies one command to the batch. Returns false when it had no effect,
+// e.g. moving the first window left, growing past kMaxWeight or resizing a
+// window that shares its row or column with no other.
+bool applyCommand(CommandBatch& batch, CommandType type) {
+    switch (type) {
+        case CommandType::MoveLeft:
+        case CommandType::MoveRight: {
+            bool forward = type == CommandType::MoveRight;
+            if (forward ? batch.slot + 1 >= batch.windows.size() : batch.slot == 0) {
+                return false;
+            }
+            size_t target = forward ? batch.slot + 1 : batch.slot - 1;
+            // Swap inside the stored order so hidden windows keep their slots.
+            auto& stored = g_windowOrder[batch.desktop];
+            std::iter_swap(std::find(stored.begin(), stored.end(), batch.windows[batch.slot]),
+                           std::find(stored.begin(), stored.end(), batch.windows[target]));
+            std::swap(batch.windows[batch.slot], batch.windows[target]);
+            batch.slot = target;
+            batch.reordered = true;
+            return true;
+        }
+        case CommandType::Grow:
+        case CommandType::Shrink: {
+            if (!kLayoutEngines[static_cast<size_t>(batch.engine)].sharesSpace(batch.windows.size(), batch.slot)) {
+                return false;
+            }
+            int delta = type == CommandType::Grow ? kWeightStep : -kWeightStep;
+            int& weight = batch.weights[batch.slot];
+            int resized = std::clamp(weight + delta, kMinWeight, kMaxWeight);
+            if (resized == weight) {
+                return false;
+            }
+            weight = resized;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace wmtiler
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <X11/X.h>
+
+#include <array>
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Window state, layout engines and command batches: everything a retile
+// decides before it talks to the X server.
+namespace wmtiler {
+
+enum class LayoutEngine { Grid, GridBalanced, MasterStack, Dwindle };
+
+struct DesktopLayout {
+    int marginLeft = 0;
+    int marginRight = 0;
+    int marginTop = 0;
+    int marginBottom = 0;
+    int gap = 0;
+    LayoutEngine engine = LayoutEngine::Grid;
+
+    bool operator==(const DesktopLayout&) const = default;
+};
+
+struct Rect {
+    int x;
+    int y;
+    int width;
+    int height;
+
+    bool operator==(const Rect&) const = default;
+};
+
+// The parts of a client's WM_NORMAL_HINTS that constrain its tiled size.
+struct SizeHints {
+    int minWidth = 0;
+    int minHeight = 0;
+    int maxWidth = 0; // 0 means unbounded
+    int maxHeight = 0;
+    int baseWidth = 0;
+    int baseHeight = 0;
+    bool hasBase = false; // PBaseSize set; base otherwise mirrors the minimum
+    int widthInc = 1;
+    int heightInc = 1;
+    int minAspectX = 0; // 0 means no aspect constraint
+    int minAspectY = 0;
+    int maxAspectX = 0;
+    int maxAspectY = 0;
+    int winGravity = NorthWestGravity;
+};
+
+// Decoration sizes from _NET_FRAME_EXTENTS; all zero once the WM has honored
+// the Motif hint and dropped the frame.
+struct FrameExtents {
+    int left = 0;
+    int right = 0;
+    int top = 0;
+    int bottom = 0;
+
+    bool operator==(const FrameExtents&) const = default;
+};
+
+// Everything a retile needs to know about a client, kept current from the
+// client's own PropertyNotify/MapNotify/UnmapNotify/DestroyNotify events.
+struct WindowState {
+    bool dockOrDesktop = false;
+    std::optional<unsigned long> desktop;
+    bool mapped = false;
+    bool maximized = false;
+    bool hidden = false;
+    Rect geometry{}; // root coordinates
+    std::optional<SizeHints> sizeHints;
+    FrameExtents frame{};
+    std::optional<Rect> requested; // outer (frame) rect of the last configure
+    bool decorationsRemoved = false;
+    bool listed = false; // present in the last _NET_CLIENT_LIST snapshot
+    bool stale = false;
+};
+
+// A monitor as reported by XRandR. Without XRandR, or when it reports no
+// monitors, the whole X screen is the only output.
+struct Output {
+    std::string name;
+    Rect area;
+};
+
+extern std::unordered_map<Window, WindowState> g_windowStates;
+// Listed clients grouped by desktop in the order they appeared, and the order
+// the user arranged them in.
+extern std::map<unsigned long, std::vector<Window>> g_desktopClients;
+extern std::map<unsigned long, std::vector<Window>> g_windowOrder;
+extern std::vector<Output> g_outputs;
+
+void orderedWindows(unsigned long desktop, std::vector<Window>& out);
+void windowsOnOutput(const std::vector<Window>& ordered, size_t output, std::vector<Window>& out);
+
+// Slot weights are percentages: kDefaultWeight is an equal share.
+constexpr int kDefaultWeight = 100;
+
+// `screen` is the area the desktop may use (the work area, margins not yet
+// applied).
+using LayoutFn = void (*)(const Rect& screen,
+                          const DesktopLayout&,
+                          std::span<const int> weights,
+                          std::span<Rect> out);
+using RelayoutFn = std::pair<size_t, size_t> (*)(const Rect& screen,
+                                                 const DesktopLayout&,
+                                                 std::span<const int> weights,
+                                                 size_t slot,
+                                                 std::span<Rect> out);
+
+struct LayoutEngineInfo {
+    LayoutEngine engine;
+    const char* name;
+    LayoutFn compute;
+    RelayoutFn relayout;
+    bool (*sharesSpace)(size_t count, size_t slot); // false: the slot's weight changes nothing
+};
+
+// Every engine selectable with --desktop-config, indexed by LayoutEngine.
+extern const std::array<LayoutEngineInfo, 4> kLayoutEngines;
+
+std::optional<LayoutEngine> parseLayoutEngine(const std::string& name);
+const LayoutEngineInfo& engineFor(const DesktopLayout& layout);
+
+// A layout depends only on the window count, the screen size and the desktop
+// profile (engine included), so recent results are kept in a small LRU table
+// and reused by repeated retiles and desktop switches. An evicted entry keeps
+// its buffer, so a miss only allocates when it needs more room.
+class LayoutCache {
+public:
+    std::span<const Rect> get(int count, const Rect& screen, const DesktopLayout& layout);
+    unsigned long hits() const { return hits_; }
+
+private:
+    struct Entry {
+        int count = 0;
+        Rect screen{};
+        DesktopLayout layout{};
+        std::vector<Rect> rects;
+        unsigned long lastUse = 0; // 0 marks an empty slot
+    };
+
+    std::array<Entry, 16> entries_{};
+    unsigned long clock_ = 0;
+    unsigned long hits_ = 0;
+};
+
+extern LayoutCache g_layoutCache;
+
+// Per-slot split weights of a desktop, changed with grow/shrink, and the rects
+// last computed from them so a weight change only recomputes the row or column
+// it affects.
+struct DesktopSplits {
+    std::vector<int> weights;
+    std::vector<Rect> rects;
+    Rect screen{};
+    DesktopLayout layout{};
+    bool valid = false;
+};
+
+// Keyed by desktop and output index.
+extern std::map<std::pair<unsigned long, size_t>, DesktopSplits> g_desktopSplits;
+
+bool hasCustomWeights(const DesktopSplits& splits, size_t count);
+std::span<Rect> splitPositions(DesktopSplits& splits,
+                               size_t count,
+                               const Rect& screen,
+                               const DesktopLayout& layout);
+
+// Where the client window itself ends up when its frame fills `outer`.
+Rect clientRect(const Rect& outer, const FrameExtents& frame);
+
+// Writes `positions` snapped to the windows' WM_NORMAL_HINTS into `out`.
+// Returns false when no window has hints and `out` is a plain copy.
+bool fitToSizeHints(std::span<const Rect> positions,
+                    const std::vector<Window>& windows,
+                    int gap,
+                    std::span<Rect> out);
+
+enum class CommandType { MoveLeft, MoveRight, Grow, Shrink };
+
+// Everything a batch of queued commands works on. The active window and its
+// output are looked up once; the commands then only rewrite the window order
+// and the split weights in memory, and the daemon sends a single configure
+// pass for the net result.
+struct CommandBatch {
+    unsigned long desktop = 0;
+    size_t output = 0;
+    LayoutEngine engine = LayoutEngine::Grid; // the output's; set by the caller
+    std::vector<Window> ordered; // every tileable window on the desktop
+    std::vector<Window> windows; // tileable windows on the output, in order
+    size_t slot = 0;             // the active window's index in `windows`
+    std::vector<int> weights;    // split weights as the commands leave them
+    bool reordered = false;
+};
+
+// Refills `batch`, reusing its storage, for the output `active` is on.
+// Returns false when `active` is not a tileable window of the desktop.
+bool beginCommandBatch(unsigned long desktop, Window active, CommandBatch& batch);
+bool applyCommand(CommandBatch& batch, CommandType type);
+
+} // namespace wmtiler
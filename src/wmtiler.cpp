@@ -1,85 +1,215 @@
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <xcb/xcb.h>
+#if __has_include(<X11/Xlib-xcb.h>)
+#include <X11/Xlib-xcb.h>
+#else
+// Some distributions ship libX11-xcb without its one-function header.
+extern "C" xcb_connection_t* XGetXCBConnection(Display* dpy);
+#endif
+#ifdef WMTILER_HAVE_XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif
 
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <cctype>
 #include <cerrno>
 #include <csignal>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <deque>
 #include <iomanip>
 #include <iostream>
 #include <map>
-#include <mutex>
 #include <optional>
+#include <span>
 #include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <iterator>
 #include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/un.h>
 #include <unistd.h>
 
+#include "tiling.hpp"
+
 namespace {
 
-struct DesktopLayout {
-    int marginLeft = 0;
-    int marginRight = 0;
-    int marginTop = 0;
-    int marginBottom = 0;
-    int gap = 0;
-};
+using namespace wmtiler;
 
 struct Config {
     bool daemon = false;
+    bool verbose = false;
     DesktopLayout defaults{};
     DesktopLayout tiledDefaults{};
     bool hasTiledDefaults = false;
     std::map<unsigned long, DesktopLayout> perDesktop;
+    std::map<std::string, DesktopLayout> perOutput;
     std::set<unsigned long> tiledDesktops;
     std::chrono::milliseconds debounce{200};
+    std::chrono::milliseconds debounceMaxWait{1000};
+    bool leadingRetile = true;
+    bool useWorkarea = true;
     std::string commandSocket = "/tmp/wmtiler.sock";
     bool sendCommand = false;
+    bool waitForReply = false;
     std::string commandToSend;
 };
 
 Display* g_display = nullptr;
-std::map<unsigned long, std::vector<Window>> g_windowOrder;
-std::atomic<bool> g_interrupted{false};
+xcb_connection_t* g_xcb = nullptr;
+
+// Last _NET_CLIENT_LIST snapshot.
+std::vector<Window> g_clients;
+bool g_clientListChanged = false;
+unsigned long g_currentDesktop = 0;
+// Desktops whose windows changed since they were last tiled.
+std::set<unsigned long> g_dirtyDesktops;
+// _NET_WORKAREA per desktop (the screen minus the panels' struts) and the
+// whole screen as a fallback, refreshed when the root properties change.
+std::vector<Rect> g_workareas;
+Rect g_screenArea{};
+
+struct DaemonStats {
+    unsigned long retiles = 0;
+    unsigned long suppressedEchoes = 0;
+    unsigned long configuresSent = 0;
+};
+
+DaemonStats g_stats;
+
+// Scratch storage for retiles; it only grows, so steady-state retiles do not
+// allocate.
+struct RetileBuffers {
+    std::vector<Window> ordered;
+    std::vector<Window> onOutput;
+    std::vector<Rect> fitted;
+};
 
-enum class CommandType { MoveLeft, MoveRight };
+RetileBuffers g_retileBuffers;
+std::atomic<bool> g_interrupted{false};
 
 struct PendingCommand {
     CommandType type;
+    // Set for "reply <command>" requests: where the outcome goes, and the
+    // connection id that tells a reused fd apart from the original client.
+    int replyFd = -1;
+    uint64_t connection = 0;
+    std::chrono::steady_clock::time_point received{};
+    // Unparseable reply-mode lines still travel through the ring, so every
+    // client sees its answers in request order.
+    const char* rejected = nullptr;
+};
+
+// The X thread's answer to a reply-mode command.
+struct CommandReply {
+    int fd = -1;
+    uint64_t connection = 0;
+    const char* error = nullptr; // nullptr on success
+    long index = -1;             // the active window's slot afterwards
+    long long latencyUs = 0;     // from parsing the command to its configure pass
+};
+
+// What processPendingCommands decided for one command; replied once the batch
+// is configured.
+struct CommandOutcome {
+    PendingCommand command;
+    const char* error;
+    long index;
 };
 
-std::mutex g_commandMutex;
-std::deque<PendingCommand> g_commandQueue;
+// Fixed-capacity lock-free queue for exactly one producer thread and one
+// consumer thread. Each index is written by one side only; the release store
+// publishes the slot contents together with the index.
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    bool push(const T& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        slots_[tail & (Capacity - 1)] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots_[head & (Capacity - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // Separate cache lines so the two threads do not contend on one line.
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::array<T, Capacity> slots_{};
+};
+
+constexpr size_t kCommandRingSize = 1024;
+
+// Listener thread -> X thread, and the replies going back.
+SpscRing<PendingCommand, kCommandRingSize> g_commandRing;
+SpscRing<CommandReply, kCommandRingSize> g_replyRing;
 std::thread g_commandThread;
 int g_commandServerFd = -1;
+int g_commandStopFd = -1; // written by stopCommandServer to end the listener
+std::atomic<bool> g_commandStopping{false};
+int g_commandEventFd = -1;
+int g_replyEventFd = -1; // wakes the listener: replies queued or ring drained
+// Set by the listener when it stops reading because g_commandRing is full.
+std::atomic<bool> g_commandRingFull{false};
 std::string g_commandSocketPath;
+// The X thread's working set for one batch of commands, reused across batches.
+CommandBatch g_commandBatch;
+std::vector<CommandOutcome> g_commandOutcomes;
+
+void drainFd(int fd) {
+    uint64_t value = 0;
+    while (read(fd, &value, sizeof(value)) > 0) {
+    }
+}
 
-void pushCommand(CommandType type) {
-    std::lock_guard<std::mutex> lock(g_commandMutex);
-    g_commandQueue.push_back(PendingCommand{type});
+void signalEventFd(int fd) {
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0) {
+        // The counter cannot overflow in practice.
+    }
 }
 
-std::vector<PendingCommand> pullCommands() {
-    std::lock_guard<std::mutex> lock(g_commandMutex);
-    std::vector<PendingCommand> out(g_commandQueue.begin(), g_commandQueue.end());
-    g_commandQueue.clear();
-    return out;
+// Called on the listener thread only. Returns false while the ring is full.
+bool pushCommand(const PendingCommand& command) {
+    if (!g_commandRing.push(command)) {
+        return false;
+    }
+    // Wakes the daemon loop, which sleeps in poll() until there is work.
+    signalEventFd(g_commandEventFd);
+    return true;
 }
 
 DesktopLayout layoutForDesktop(const Config& cfg, unsigned long desktop);
@@ -103,11 +233,17 @@ std::optional<CommandType> parseCommandString(const std::string& text) {
     if (text == "move-right") {
         return CommandType::MoveRight;
     }
+    if (text == "grow") {
+        return CommandType::Grow;
+    }
+    if (text == "shrink") {
+        return CommandType::Shrink;
+    }
     return std::nullopt;
 }
 
 int createCommandServer(const std::string& path) {
-    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (fd < 0) {
         return -1;
     }
@@ -123,7 +259,7 @@ int createCommandServer(const std::string& path) {
         close(fd);
         return -1;
     }
-    if (listen(fd, 4) < 0) {
+    if (listen(fd, SOMAXCONN) < 0) {
         close(fd);
         unlink(path.c_str());
         return -1;
@@ -131,44 +267,360 @@ int createCommandServer(const std::string& path) {
     return fd;
 }
 
-void commandListenerLoop() {
-    while (!g_interrupted) {
-        int client = accept(g_commandServerFd, nullptr, nullptr);
-        if (client < 0) {
-            if (errno == EINTR) {
+// A line longer than this is not a command; the connection is dropped rather
+// than buffering without bound.
+constexpr size_t kMaxCommandLine = 1024;
+
+// Extra connections are closed on accept; a client this far behind is dropped.
+constexpr size_t kMaxCommandClients = 64;
+constexpr size_t kMaxReplyBacklog = 64 * 1024;
+
+// Serves newline-framed commands from persistent clients over one epoll set.
+class CommandListener {
+public:
+    void run() {
+        epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd_ < 0) {
+            std::cerr << "Warning: epoll_create1 failed: " << std::strerror(errno) << '\n';
+            return;
+        }
+        reserveFd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        watch(g_commandServerFd, EPOLLIN, EPOLL_CTL_ADD);
+        watch(g_commandStopFd, EPOLLIN, EPOLL_CTL_ADD);
+        watch(g_replyEventFd, EPOLLIN, EPOLL_CTL_ADD);
+
+        epoll_event ready[64];
+        bool stopping = false;
+        while (!stopping) {
+            int count = epoll_wait(epollFd_, ready, static_cast<int>(std::size(ready)), -1);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Warning: epoll_wait failed: " << std::strerror(errno) << '\n';
+                break;
+            }
+            for (int i = 0; i < count; ++i) {
+                int fd = ready[i].data.fd;
+                if (fd == g_commandStopFd) {
+                    stopping = true;
+                } else if (fd == g_commandServerFd) {
+                    acceptClients();
+                } else if (fd == g_replyEventFd) {
+                    deliverReplies();
+                    resumeStalledClients();
+                } else if (auto it = clients_.find(fd); it != clients_.end()) {
+                    if (ready[i].events & EPOLLOUT) {
+                        flush(fd, it->second);
+                    }
+                    if (ready[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                        readClient(fd, it->second);
+                    }
+                    // HUP means fully closed; only a half-close waits for replies.
+                    if (ready[i].events & (EPOLLHUP | EPOLLERR)) {
+                        hangUp(fd, it->second);
+                    }
+                }
+            }
+            closeFinishedClients();
+        }
+
+        while (!clients_.empty()) {
+            closeClient(clients_.begin()->first);
+        }
+        if (reserveFd_ >= 0) {
+            close(reserveFd_);
+        }
+        close(epollFd_);
+    }
+
+private:
+    struct Client {
+        uint64_t id = 0;
+        std::string in;  // bytes after the last complete line
+        std::string out; // replies the socket did not take yet
+        size_t awaitingReplies = 0;
+        bool readClosed = false; // peer half-closed; close once answered
+        bool stalled = false;    // command ring full; not read until it drains
+        bool hungUp = false;     // fully closed while stalled; out of the epoll set
+        uint32_t events = EPOLLIN | EPOLLRDHUP; // as registered with epoll
+        bool broken = false;
+    };
+
+    void watch(int fd, uint32_t events, int op) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        epoll_ctl(epollFd_, op, fd, &event);
+    }
+
+    void acceptClients() {
+        while (true) {
+            int fd = accept4(g_commandServerFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EMFILE || errno == ENFILE) {
+                    shedConnection();
+                }
+                return;
+            }
+            if (clients_.size() >= kMaxCommandClients) {
+                close(fd);
+                continue;
+            }
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = fd;
+            if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+                close(fd);
+                continue;
+            }
+            clients_[fd].id = ++nextId_;
+        }
+    }
+
+    // At EMFILE, spend the reserve fd to drop the connection, else pause accepting.
+    void shedConnection() {
+        if (reserveFd_ >= 0) {
+            close(reserveFd_);
+            int fd = accept4(g_commandServerFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                close(fd);
+            }
+            reserveFd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        }
+        if (reserveFd_ < 0 && !acceptPaused_) {
+            watch(g_commandServerFd, 0, EPOLL_CTL_MOD);
+            acceptPaused_ = true;
+        }
+    }
+
+    void readClient(int fd, Client& client) {
+        char chunk[4096];
+        while (!client.readClosed && !client.broken && !client.stalled) {
+            ssize_t len = read(fd, chunk, sizeof(chunk));
+            if (len > 0) {
+                client.in.append(chunk, static_cast<size_t>(len));
+                consumeLines(fd, client);
+                if (!client.stalled && client.in.size() > kMaxCommandLine) {
+                    client.broken = true;
+                }
+            } else if (len < 0 && errno == EINTR) {
                 continue;
+            } else if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            } else {
+                if (len < 0) {
+                    client.broken = true;
+                    return;
+                }
+                // EOF: older clients may not terminate their only command.
+                if (!client.in.empty()) {
+                    client.in.push_back('\n');
+                    consumeLines(fd, client);
+                }
+                client.readClosed = true;
+                updateEvents(fd, client);
+            }
+        }
+    }
+
+    // Queues every complete line in the client's buffer and keeps the
+    // unfinished tail for the next read. Stops at a full ring, leaving the
+    // rest of the lines for resumeStalledClients.
+    void consumeLines(int fd, Client& client) {
+        size_t start = 0;
+        for (size_t newline; (newline = client.in.find('\n', start)) != std::string::npos;
+             start = newline + 1) {
+            auto line = trim(client.in.substr(start, newline - start));
+            bool wantsReply = line.rfind("reply ", 0) == 0;
+            if (wantsReply) {
+                line = trim(line.substr(6));
             }
-            if (g_interrupted) {
+            auto parsed = parseCommandString(line);
+            if (!parsed && !wantsReply) {
+                continue;
+            }
+            PendingCommand command{parsed.value_or(CommandType::MoveLeft)};
+            if (!parsed) {
+                command.rejected = "unknown-command";
+            }
+            if (wantsReply) {
+                command.replyFd = fd;
+                command.connection = client.id;
+                command.received = std::chrono::steady_clock::now();
+            }
+            if (!pushCommand(command)) {
+                // The X thread answers the flag through g_replyEventFd.
+                g_commandRingFull = true;
+                client.stalled = true;
+                ++stalledClients_;
                 break;
             }
-            continue;
+            if (wantsReply) {
+                ++client.awaitingReplies;
+            }
         }
-        char buffer[128];
-        ssize_t len = read(client, buffer, sizeof(buffer) - 1);
-        if (len > 0) {
-            buffer[len] = '\0';
-            auto cmd = trim(buffer);
-            if (auto parsed = parseCommandString(cmd)) {
-                pushCommand(*parsed);
+        client.in.erase(0, start);
+        updateEvents(fd, client);
+    }
+
+    void resumeStalledClients() {
+        for (auto it = clients_.begin(); stalledClients_ > 0 && it != clients_.end(); ++it) {
+            auto& [fd, client] = *it;
+            if (!client.stalled) {
+                continue;
             }
+            client.stalled = false;
+            --stalledClients_;
+            consumeLines(fd, client);
+            readClient(fd, client);
+        }
+    }
+
+    // A stalled client still has queued lines, so it is only taken out of
+    // the epoll set (HUP cannot be masked) and finished on resume.
+    void hangUp(int fd, Client& client) {
+        if (!client.stalled) {
+            client.broken = true;
+        } else if (!client.hungUp) {
+            epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+            client.hungUp = true;
         }
-        close(client);
     }
+
+    void deliverReplies() {
+        drainFd(g_replyEventFd);
+        CommandReply reply;
+        while (g_replyRing.pop(reply)) {
+            auto it = clients_.find(reply.fd);
+            if (it == clients_.end() || it->second.id != reply.connection) {
+                continue; // the client went away before its answer was ready
+            }
+            --it->second.awaitingReplies;
+            send(reply.fd, it->second, reply);
+        }
+    }
+
+    void send(int fd, Client& client, const CommandReply& reply) {
+        char line[96];
+        int len = reply.error
+                      ? std::snprintf(line, sizeof(line), "error %s %lld\n", reply.error, reply.latencyUs)
+                      : std::snprintf(line, sizeof(line), "ok %ld %lld\n", reply.index, reply.latencyUs);
+        client.out.append(line, static_cast<size_t>(len));
+        if (client.out.size() > kMaxReplyBacklog) {
+            client.broken = true;
+            return;
+        }
+        flush(fd, client);
+    }
+
+    void flush(int fd, Client& client) {
+        while (!client.out.empty()) {
+            ssize_t sent = ::send(fd, client.out.data(), client.out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent > 0) {
+                client.out.erase(0, static_cast<size_t>(sent));
+            } else if (sent < 0 && errno == EINTR) {
+                continue;
+            } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                client.broken = true;
+                return;
+            }
+        }
+        updateEvents(fd, client);
+    }
+
+    // Only touches epoll when the client's interest actually changes.
+    void updateEvents(int fd, Client& client) {
+        if (client.hungUp) {
+            return;
+        }
+        uint32_t events = client.readClosed || client.stalled ? 0 : EPOLLIN | EPOLLRDHUP;
+        if (!client.out.empty()) {
+            events |= EPOLLOUT;
+        }
+        if (events != client.events) {
+            watch(fd, events, EPOLL_CTL_MOD);
+            client.events = events;
+        }
+    }
+
+    void closeFinishedClients() {
+        for (auto it = clients_.begin(); it != clients_.end();) {
+            const Client& client = it->second;
+            bool done = client.readClosed && !client.stalled && client.awaitingReplies == 0 &&
+                        client.out.empty();
+            int fd = it->first;
+            ++it;
+            if (client.broken || done) {
+                closeClient(fd);
+            }
+        }
+    }
+
+    void closeClient(int fd) {
+        if (clients_[fd].stalled) {
+            --stalledClients_;
+        }
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        clients_.erase(fd);
+        if (acceptPaused_) {
+            reserveFd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            watch(g_commandServerFd, EPOLLIN, EPOLL_CTL_MOD);
+            acceptPaused_ = false;
+        }
+    }
+
+    int epollFd_ = -1;
+    int reserveFd_ = -1; // spare descriptor for shedding connections at EMFILE
+    bool acceptPaused_ = false;
+    size_t stalledClients_ = 0;
+    uint64_t nextId_ = 0;
+    std::unordered_map<int, Client> clients_;
+};
+
+void commandListenerLoop() {
+    CommandListener().run();
+}
+
+// Called on the X thread. Waits while the listener catches up rather than
+// losing an answer a client is blocked on.
+void postReply(const CommandReply& reply) {
+    while (!g_replyRing.push(reply)) {
+        if (g_commandStopping) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    signalEventFd(g_replyEventFd);
 }
 
 void stopCommandServer() {
+    if (g_commandThread.joinable()) {
+        g_commandStopping = true;
+        signalEventFd(g_commandStopFd);
+        g_commandThread.join();
+    }
     if (g_commandServerFd >= 0) {
         close(g_commandServerFd);
         g_commandServerFd = -1;
     }
+    if (g_commandStopFd >= 0) {
+        close(g_commandStopFd);
+        g_commandStopFd = -1;
+    }
     if (!g_commandSocketPath.empty()) {
         unlink(g_commandSocketPath.c_str());
     }
-    if (g_commandThread.joinable()) {
-        g_commandThread.join();
-    }
 }
 
+constexpr int kReplyTimeoutSeconds = 5;
+
 bool sendIpcCommand(const Config& cfg) {
     int fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (fd < 0) {
@@ -189,38 +641,124 @@ bool sendIpcCommand(const Config& cfg) {
         close(fd);
         return false;
     }
-    std::string payload = cfg.commandToSend;
+    std::string payload = cfg.waitForReply ? "reply " + cfg.commandToSend : cfg.commandToSend;
     payload.push_back('\n');
     ssize_t written = write(fd, payload.data(), payload.size());
-    close(fd);
     if (written != static_cast<ssize_t>(payload.size())) {
         std::cerr << "Failed to send the full command payload\n";
+        close(fd);
         return false;
     }
-    return true;
+    if (!cfg.waitForReply) {
+        close(fd);
+        return true;
+    }
+    // A wedged daemon must not hang the hotkey script.
+    timeval timeout{kReplyTimeoutSeconds, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    // "ok <index> <latency-us>" or "error <reason> <latency-us>"
+    std::string reply;
+    char chunk[128];
+    ssize_t len = 0;
+    while (reply.find('\n') == std::string::npos && (len = read(fd, chunk, sizeof(chunk))) > 0) {
+        reply.append(chunk, static_cast<size_t>(len));
+    }
+    bool timedOut = len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    close(fd);
+    auto newline = reply.find('\n');
+    if (newline == std::string::npos && timedOut) {
+        std::cerr << "Timed out after " << kReplyTimeoutSeconds << "s waiting for a reply from "
+                  << cfg.commandSocket << '\n';
+        return false;
+    }
+    if (newline == std::string::npos) {
+        std::cerr << "No reply from the daemon at " << cfg.commandSocket << '\n';
+        return false;
+    }
+    reply.resize(newline);
+    std::cout << reply << std::endl;
+    return reply.rfind("ok ", 0) == 0;
 }
 
 [[noreturn]] void fail(const std::string& msg) {
     throw std::runtime_error(msg);
 }
 
-class AtomCache {
-public:
-    explicit AtomCache(Display* dpy) : display_(dpy) {}
+// Clients can disappear between the moment we learn about them and the moment
+// we touch them, so BadWindow is expected and must not abort the daemon.
+int handleXError(Display* dpy, XErrorEvent* error) {
+    if (error->error_code == BadWindow) {
+        return 0;
+    }
+    char text[256];
+    XGetErrorText(dpy, error->error_code, text, sizeof(text));
+    std::cerr << "X error: " << text << " (request " << static_cast<int>(error->request_code)
+              << ")\n";
+    return 0;
+}
 
-    Atom get(const char* name) {
-        auto it = cache_.find(name);
-        if (it != cache_.end()) {
-            return it->second;
+enum class AtomId : size_t {
+    NetClientList,
+    NetCurrentDesktop,
+    NetNumberOfDesktops,
+    NetWorkarea,
+    NetActiveWindow,
+    NetWmDesktop,
+    NetWmWindowType,
+    NetWmWindowTypeDock,
+    NetWmWindowTypeDesktop,
+    NetWmState,
+    NetWmStateMaximizedHorz,
+    NetWmStateMaximizedVert,
+    NetWmStateHidden,
+    NetFrameExtents,
+    MotifWmHints,
+    Count,
+};
+
+constexpr size_t kAtomCount = static_cast<size_t>(AtomId::Count);
+
+// Indexed by AtomId; keep both lists in the same order.
+constexpr std::array<const char*, kAtomCount> kAtomNames = {
+    "_NET_CLIENT_LIST",
+    "_NET_CURRENT_DESKTOP",
+    "_NET_NUMBER_OF_DESKTOPS",
+    "_NET_WORKAREA",
+    "_NET_ACTIVE_WINDOW",
+    "_NET_WM_DESKTOP",
+    "_NET_WM_WINDOW_TYPE",
+    "_NET_WM_WINDOW_TYPE_DOCK",
+    "_NET_WM_WINDOW_TYPE_DESKTOP",
+    "_NET_WM_STATE",
+    "_NET_WM_STATE_MAXIMIZED_HORZ",
+    "_NET_WM_STATE_MAXIMIZED_VERT",
+    "_NET_WM_STATE_HIDDEN",
+    "_NET_FRAME_EXTENTS",
+    "_MOTIF_WM_HINTS",
+};
+
+static_assert(std::none_of(kAtomNames.begin(), kAtomNames.end(),
+                           [](const char* name) { return name == nullptr; }),
+              "every AtomId needs a name in kAtomNames");
+
+// Every atom wmtiler uses, interned with a single XInternAtoms round trip at
+// startup so lookups are plain array indexing.
+class AtomTable {
+public:
+    explicit AtomTable(Display* dpy) {
+        std::array<char*, kAtomCount> names{};
+        for (size_t i = 0; i < kAtomCount; ++i) {
+            names[i] = const_cast<char*>(kAtomNames[i]);
+        }
+        if (!XInternAtoms(dpy, names.data(), static_cast<int>(kAtomCount), False, atoms_.data())) {
+            fail("Failed to intern X atoms");
         }
-        Atom atom = XInternAtom(display_, name, False);
-        cache_.emplace(name, atom);
-        return atom;
     }
 
+    Atom get(AtomId id) const { return atoms_[static_cast<size_t>(id)]; }
+
 private:
-    Display* display_;
-    std::map<std::string, Atom> cache_;
+    std::array<Atom, kAtomCount> atoms_{};
 };
 
 struct MotifHints {
@@ -341,7 +879,7 @@ std::vector<Window> getWindowList(Display* dpy, Window root, Atom prop) {
     return result;
 }
 
-std::optional<Window> getActiveWindow(Display* dpy, Window root, AtomCache& atoms) {
+std::optional<Window> getActiveWindow(Display* dpy, Window root, const AtomTable& atoms) {
     Atom actualType;
     int actualFormat;
     unsigned long itemCount = 0;
@@ -349,7 +887,7 @@ std::optional<Window> getActiveWindow(Display* dpy, Window root, AtomCache& atom
     unsigned char* data = nullptr;
     if (XGetWindowProperty(dpy,
                            root,
-                           atoms.get("_NET_ACTIVE_WINDOW"),
+                           atoms.get(AtomId::NetActiveWindow),
                            0,
                            (~0L),
                            False,
@@ -371,108 +909,437 @@ std::optional<Window> getActiveWindow(Display* dpy, Window root, AtomCache& atom
     return result;
 }
 
-std::optional<unsigned long> getWindowDesktop(Display* dpy, Window win, AtomCache& atoms) {
-    auto owned = getCardinalProperty(dpy, win, atoms.get("_NET_WM_DESKTOP"));
-    if (!owned || owned.size() == 0) {
+struct ClientInfo {
+    Window window = None;
+    bool dockOrDesktop = false;
+    std::optional<unsigned long> desktop;
+    bool mapped = false;
+    bool maximized = false;
+    bool hidden = false;
+    Rect geometry{};
+    std::optional<SizeHints> sizeHints;
+    FrameExtents frame{};
+};
+
+// Decodes a WM_SIZE_HINTS property. ICCCM lets base and minimum size stand in
+// for each other when only one of them is set.
+std::optional<SizeHints> parseSizeHints(xcb_get_property_reply_t* reply) {
+    constexpr int kOldFieldCount = 15; // pre-ICCCM clients omit base size and gravity
+    if (reply->type != XCB_ATOM_WM_SIZE_HINTS || reply->format != 32 ||
+        xcb_get_property_value_length(reply) < kOldFieldCount * 4) {
         return std::nullopt;
     }
-    constexpr unsigned long kDesktopSticky = 0xFFFFFFFF;
-    auto desktop = owned.data()[0];
-    if (desktop == kDesktopSticky) {
-        return std::nullopt;
+    auto* fields = static_cast<int32_t*>(xcb_get_property_value(reply));
+    bool hasBaseAndGravity = xcb_get_property_value_length(reply) >= 18 * 4;
+    uint32_t flags = static_cast<uint32_t>(fields[0]);
+    SizeHints hints;
+    if (flags & PMinSize) {
+        hints.minWidth = std::max(0, fields[5]);
+        hints.minHeight = std::max(0, fields[6]);
+    }
+    if (flags & PMaxSize) {
+        hints.maxWidth = std::max(0, fields[7]);
+        hints.maxHeight = std::max(0, fields[8]);
+    }
+    if (flags & PResizeInc) {
+        hints.widthInc = std::max(1, fields[9]);
+        hints.heightInc = std::max(1, fields[10]);
+    }
+    if ((flags & PAspect) && fields[11] > 0 && fields[12] > 0 && fields[13] > 0 && fields[14] > 0) {
+        hints.minAspectX = fields[11];
+        hints.minAspectY = fields[12];
+        hints.maxAspectX = fields[13];
+        hints.maxAspectY = fields[14];
+    }
+    if (hasBaseAndGravity && (flags & PBaseSize)) {
+        hints.baseWidth = std::max(0, fields[15]);
+        hints.baseHeight = std::max(0, fields[16]);
+        hints.hasBase = true;
+        if (!(flags & PMinSize)) {
+            hints.minWidth = hints.baseWidth;
+            hints.minHeight = hints.baseHeight;
+        }
+    } else {
+        hints.baseWidth = hints.minWidth;
+        hints.baseHeight = hints.minHeight;
+    }
+    if (hasBaseAndGravity && (flags & PWinGravity)) {
+        hints.winGravity = fields[17];
     }
-    return desktop;
+    return hints;
 }
 
-bool isDockOrDesktop(Display* dpy, Window win, AtomCache& atoms) {
-    Atom actualType;
-    int actualFormat;
-    unsigned long itemCount = 0;
-    unsigned long bytesAfter = 0;
-    unsigned char* data = nullptr;
-    if (XGetWindowProperty(dpy,
-                           win,
-                           atoms.get("_NET_WM_WINDOW_TYPE"),
-                           0,
-                           (~0L),
-                           False,
-                           XA_ATOM,
-                           &actualType,
-                           &actualFormat,
-                           &itemCount,
-                           &bytesAfter,
-                           &data) != Success) {
+// Sends every property/attribute request for all windows before reading any
+// reply, so the whole batch costs a single round trip regardless of its size.
+std::vector<ClientInfo> fetchClientInfo(xcb_connection_t* conn,
+                                        Window root,
+                                        const std::vector<Window>& windows,
+                                        const AtomTable& atoms) {
+    struct Pending {
+        xcb_get_property_cookie_t type;
+        xcb_get_property_cookie_t desktop;
+        xcb_get_property_cookie_t state;
+        xcb_get_property_cookie_t normalHints;
+        xcb_get_property_cookie_t frameExtents;
+        xcb_get_window_attributes_cookie_t attrs;
+        xcb_get_geometry_cookie_t geometry;
+        xcb_translate_coordinates_cookie_t position;
+    };
+    Atom typeAtom = atoms.get(AtomId::NetWmWindowType);
+    Atom desktopAtom = atoms.get(AtomId::NetWmDesktop);
+    Atom dock = atoms.get(AtomId::NetWmWindowTypeDock);
+    Atom desktopType = atoms.get(AtomId::NetWmWindowTypeDesktop);
+    Atom stateAtom = atoms.get(AtomId::NetWmState);
+    Atom maxHorz = atoms.get(AtomId::NetWmStateMaximizedHorz);
+    Atom maxVert = atoms.get(AtomId::NetWmStateMaximizedVert);
+    Atom hidden = atoms.get(AtomId::NetWmStateHidden);
+    Atom frameExtentsAtom = atoms.get(AtomId::NetFrameExtents);
+
+    std::vector<Pending> pending;
+    pending.reserve(windows.size());
+    for (auto win : windows) {
+        auto id = static_cast<xcb_window_t>(win);
+        pending.push_back(Pending{
+            xcb_get_property(conn, 0, id, typeAtom, XCB_ATOM_ATOM, 0, 32),
+            xcb_get_property(conn, 0, id, desktopAtom, XCB_ATOM_CARDINAL, 0, 1),
+            xcb_get_property(conn, 0, id, stateAtom, XCB_ATOM_ATOM, 0, 32),
+            xcb_get_property(conn, 0, id, XCB_ATOM_WM_NORMAL_HINTS, XCB_ATOM_WM_SIZE_HINTS, 0, 18),
+            xcb_get_property(conn, 0, id, frameExtentsAtom, XCB_ATOM_CARDINAL, 0, 4),
+            xcb_get_window_attributes(conn, id),
+            xcb_get_geometry(conn, id),
+            xcb_translate_coordinates(conn, id, static_cast<xcb_window_t>(root), 0, 0),
+        });
+    }
+
+    std::vector<ClientInfo> result;
+    result.reserve(windows.size());
+    for (size_t i = 0; i < windows.size(); ++i) {
+        ClientInfo info;
+        info.window = windows[i];
+
+        if (auto* reply = xcb_get_property_reply(conn, pending[i].type, nullptr)) {
+            if (reply->type == XCB_ATOM_ATOM && reply->format == 32) {
+                auto* types = static_cast<xcb_atom_t*>(xcb_get_property_value(reply));
+                int count = xcb_get_property_value_length(reply) / 4;
+                for (int t = 0; t < count; ++t) {
+                    if (types[t] == dock || types[t] == desktopType) {
+                        info.dockOrDesktop = true;
+                        break;
+                    }
+                }
+            }
+            std::free(reply);
+        }
+
+        if (auto* reply = xcb_get_property_reply(conn, pending[i].desktop, nullptr)) {
+            if (reply->type == XCB_ATOM_CARDINAL && reply->format == 32 &&
+                xcb_get_property_value_length(reply) >= 4) {
+                constexpr uint32_t kDesktopSticky = 0xFFFFFFFF;
+                auto desktop = *static_cast<uint32_t*>(xcb_get_property_value(reply));
+                if (desktop != kDesktopSticky) {
+                    info.desktop = desktop;
+                }
+            }
+            std::free(reply);
+        }
+
+        if (auto* reply = xcb_get_property_reply(conn, pending[i].state, nullptr)) {
+            if (reply->type == XCB_ATOM_ATOM && reply->format == 32) {
+                auto* states = static_cast<xcb_atom_t*>(xcb_get_property_value(reply));
+                int count = xcb_get_property_value_length(reply) / 4;
+                for (int t = 0; t < count; ++t) {
+                    if (states[t] == maxHorz || states[t] == maxVert) {
+                        info.maximized = true;
+                    } else if (states[t] == hidden) {
+                        info.hidden = true;
+                    }
+                }
+            }
+            std::free(reply);
+        }
+
+        if (auto* reply = xcb_get_property_reply(conn, pending[i].normalHints, nullptr)) {
+            info.sizeHints = parseSizeHints(reply);
+            std::free(reply);
+        }
+
+        if (auto* reply = xcb_get_property_reply(conn, pending[i].frameExtents, nullptr)) {
+            if (reply->type == XCB_ATOM_CARDINAL && reply->format == 32 &&
+                xcb_get_property_value_length(reply) >= 16) {
+                auto* extents = static_cast<uint32_t*>(xcb_get_property_value(reply));
+                info.frame = FrameExtents{static_cast<int>(extents[0]),
+                                          static_cast<int>(extents[1]),
+                                          static_cast<int>(extents[2]),
+                                          static_cast<int>(extents[3])};
+            }
+            std::free(reply);
+        }
+
+        auto* attrs = xcb_get_window_attributes_reply(conn, pending[i].attrs, nullptr);
+        auto* geometry = xcb_get_geometry_reply(conn, pending[i].geometry, nullptr);
+        auto* position = xcb_translate_coordinates_reply(conn, pending[i].position, nullptr);
+        if (attrs && geometry && position) {
+            info.mapped = attrs->map_state != XCB_MAP_STATE_UNMAPPED;
+            // The geometry reply is relative to the WM's frame; the window's
+            // output is picked from where it sits on the root window.
+            info.geometry = Rect{position->dst_x, position->dst_y, geometry->width, geometry->height};
+            result.push_back(info);
+        }
+        // A missing reply means the window is already gone.
+        std::free(attrs);
+        std::free(geometry);
+        std::free(position);
+    }
+    return result;
+}
+
+// Returns true when the dirtied desktop is the visible one.
+bool markDesktopDirty(std::optional<unsigned long> desktop) {
+    if (!desktop) {
         return false;
     }
-    bool result = false;
-    if (actualType == XA_ATOM && actualFormat == 32) {
-        Atom* types = reinterpret_cast<Atom*>(data);
-        Atom dock = atoms.get("_NET_WM_WINDOW_TYPE_DOCK");
-        Atom desktop = atoms.get("_NET_WM_WINDOW_TYPE_DESKTOP");
-        for (unsigned long i = 0; i < itemCount; ++i) {
-            if (types[i] == dock || types[i] == desktop) {
-                result = true;
-                break;
+    g_dirtyDesktops.insert(*desktop);
+    return *desktop == g_currentDesktop;
+}
+
+void indexClient(Window win, std::optional<unsigned long> desktop) {
+    if (desktop) {
+        g_desktopClients[*desktop].push_back(win);
+    }
+}
+
+void unindexClient(Window win, std::optional<unsigned long> desktop) {
+    if (!desktop) {
+        return;
+    }
+    auto it = g_desktopClients.find(*desktop);
+    if (it == g_desktopClients.end()) {
+        return;
+    }
+    auto& members = it->second;
+    members.erase(std::remove(members.begin(), members.end(), win), members.end());
+    if (members.empty()) {
+        g_desktopClients.erase(it);
+    }
+}
+
+// Drops a window that no longer exists. Returns true when that dirtied the
+// visible desktop.
+bool forgetWindow(std::unordered_map<Window, WindowState>::iterator it) {
+    auto desktop = it->second.desktop;
+    if (it->second.listed) {
+        unindexClient(it->first, desktop);
+    }
+    g_windowStates.erase(it);
+    return markDesktopDirty(desktop);
+}
+
+// Subscribes to the clients' own events, then records their state in
+// g_windowStates. g_xcb is the display's own connection, so the server
+// handles the XSelectInput requests before the fetch: a change that lands
+// after the fetch was served still produces a PropertyNotify.
+void trackWindows(Display* dpy, const std::vector<Window>& windows, const AtomTable& atoms) {
+    if (windows.empty()) {
+        return;
+    }
+    for (auto win : windows) {
+        XSelectInput(dpy, win, PropertyChangeMask | StructureNotifyMask);
+    }
+    XFlush(dpy);
+    std::unordered_set<Window> gone(windows.begin(), windows.end());
+    for (const auto& info : fetchClientInfo(g_xcb, DefaultRootWindow(dpy), windows, atoms)) {
+        gone.erase(info.window);
+        auto& state = g_windowStates[info.window];
+        if (state.desktop != info.desktop) {
+            markDesktopDirty(state.desktop);
+            markDesktopDirty(info.desktop);
+            if (state.listed) {
+                unindexClient(info.window, state.desktop);
+                indexClient(info.window, info.desktop);
             }
+        } else if (state.stale) {
+            markDesktopDirty(info.desktop);
+        }
+        state.dockOrDesktop = info.dockOrDesktop;
+        state.desktop = info.desktop;
+        state.mapped = info.mapped;
+        state.maximized = info.maximized;
+        state.hidden = info.hidden;
+        state.geometry = info.geometry;
+        state.sizeHints = info.sizeHints;
+        if (state.frame != info.frame) {
+            // Same outer rect, different client size: configure again.
+            state.frame = info.frame;
+            state.requested.reset();
         }
+        state.stale = false;
     }
-    if (data) {
-        XFree(data);
+    for (auto win : gone) {
+        auto it = g_windowStates.find(win);
+        if (it != g_windowStates.end()) {
+            forgetWindow(it);
+        }
     }
-    return result;
 }
 
-std::vector<Window> collectWindows(Display* dpy,
-                                   Window root,
-                                   unsigned long desktop,
-                                   AtomCache& atoms) {
-    auto list = getWindowList(dpy, root, atoms.get("_NET_CLIENT_LIST_STACKING"));
-    std::vector<Window> filtered;
-    for (auto win : list) {
-        if (isDockOrDesktop(dpy, win, atoms)) {
-            continue;
+// True when a ConfigureNotify only reports the geometry we asked for. Real
+// events from a reparenting WM carry frame-relative coordinates, so only the
+// synthetic ones (sent in root coordinates per ICCCM) can be compared by
+// position.
+bool isEcho(const XConfigureEvent& conf, const Rect& expected) {
+    if (conf.width != expected.width || conf.height != expected.height) {
+        return false;
+    }
+    return !conf.send_event || (conf.x == expected.x && conf.y == expected.y);
+}
+
+// Updates g_windowStates from an event on a tracked client and marks the
+// affected desktop dirty. Returns true when the change needs a retile pass:
+// the visible desktop became dirty or the window has to be refetched.
+bool applyWindowEvent(const XEvent& event, const AtomTable& atoms) {
+    switch (event.type) {
+        case PropertyNotify: {
+            auto it = g_windowStates.find(event.xproperty.window);
+            if (it == g_windowStates.end()) {
+                return false;
+            }
+            auto atom = event.xproperty.atom;
+            if (atom == atoms.get(AtomId::NetWmDesktop) ||
+                atom == atoms.get(AtomId::NetWmWindowType) ||
+                atom == atoms.get(AtomId::NetWmState) || atom == atoms.get(AtomId::NetFrameExtents) ||
+                atom == XA_WM_NORMAL_HINTS) {
+                it->second.stale = true;
+                markDesktopDirty(it->second.desktop);
+                return true;
+            }
+            return false;
         }
-        auto winDesktop = getWindowDesktop(dpy, win, atoms);
-        if (winDesktop && *winDesktop == desktop) {
-            XWindowAttributes attrs;
-            if (!XGetWindowAttributes(dpy, win, &attrs)) {
-                continue;
+        case MapNotify:
+        case UnmapNotify: {
+            Window win = event.type == MapNotify ? event.xmap.window : event.xunmap.window;
+            auto it = g_windowStates.find(win);
+            if (it == g_windowStates.end()) {
+                return false;
             }
-            if (attrs.map_state != IsViewable) {
-                continue;
+            it->second.mapped = event.type == MapNotify;
+            // A hidden desktop is only marked: the WM may map its clients
+            // before publishing _NET_CURRENT_DESKTOP. Retiling it once shown
+            // sends nothing if its layout did not change.
+            return markDesktopDirty(it->second.desktop);
+        }
+        case DestroyNotify: {
+            auto it = g_windowStates.find(event.xdestroywindow.window);
+            if (it == g_windowStates.end()) {
+                return false;
             }
-            filtered.emplace_back(win);
+            return forgetWindow(it);
         }
+        case ConfigureNotify: {
+            const auto& conf = event.xconfigure;
+            // Frames and override-redirect windows show up through root's
+            // SubstructureNotify; client changes arrive on the client itself.
+            if (conf.event != conf.window) {
+                return false;
+            }
+            auto it = g_windowStates.find(conf.window);
+            if (it == g_windowStates.end()) {
+                return false;
+            }
+            auto& state = it->second;
+            state.geometry.width = conf.width;
+            state.geometry.height = conf.height;
+            if (conf.send_event) {
+                state.geometry.x = conf.x;
+                state.geometry.y = conf.y;
+            }
+            if (!state.requested) {
+                return markDesktopDirty(state.desktop);
+            }
+            Rect expected = clientRect(*state.requested, state.frame);
+            if (isEcho(conf, expected)) {
+                ++g_stats.suppressedEchoes;
+                return false;
+            }
+            // Size-only differences are the WM or client applying its own
+            // constraints; asking again would just loop. A different position
+            // means the window was moved away, so let the next retile put it
+            // back.
+            if (conf.send_event && (conf.x != expected.x || conf.y != expected.y)) {
+                state.requested.reset();
+            }
+            return markDesktopDirty(state.desktop);
+        }
+        default:
+            return false;
     }
-    return filtered;
 }
 
-std::vector<Window> stableOrder(unsigned long desktop, const std::vector<Window>& current) {
-    auto& stored = g_windowOrder[desktop];
-    std::vector<Window> result;
-    result.reserve(current.size());
-    std::unordered_set<Window> remaining(current.begin(), current.end());
+// Applies the difference between the previous and the current
+// _NET_CLIENT_LIST snapshot: new clients are fetched (in one batch) and
+// indexed, removed ones are unindexed, and the desktops they belong to are
+// marked dirty. Unchanged clients are not touched.
+void syncClientList(Display* dpy, Window root, const AtomTable& atoms) {
+    auto list = getWindowList(dpy, root, atoms.get(AtomId::NetClientList));
+    std::unordered_set<Window> listed(list.begin(), list.end());
+    for (auto win : g_clients) {
+        if (listed.count(win)) {
+            continue;
+        }
+        auto it = g_windowStates.find(win);
+        if (it != g_windowStates.end() && it->second.listed) {
+            it->second.listed = false;
+            unindexClient(win, it->second.desktop);
+            markDesktopDirty(it->second.desktop);
+        }
+    }
 
-    for (auto win : stored) {
-        if (remaining.erase(win) > 0) {
-            result.push_back(win);
+    std::unordered_set<Window> previous(g_clients.begin(), g_clients.end());
+    std::vector<Window> added;
+    std::vector<Window> unknown;
+    for (auto win : list) {
+        if (previous.count(win)) {
+            continue;
+        }
+        added.push_back(win);
+        if (!g_windowStates.count(win)) {
+            unknown.push_back(win);
         }
     }
-    for (auto win : current) {
-        if (remaining.erase(win) > 0) {
-            result.push_back(win);
+    trackWindows(dpy, unknown, atoms);
+    for (auto win : added) {
+        auto it = g_windowStates.find(win);
+        if (it != g_windowStates.end() && !it->second.listed) {
+            it->second.listed = true;
+            indexClient(win, it->second.desktop);
+            markDesktopDirty(it->second.desktop);
         }
     }
-    stored = result;
-    return result;
+    g_clients = std::move(list);
+    g_clientListChanged = false;
+}
+
+// Brings g_windowStates up to date before a retile or a command: syncs the
+// client list if it changed and refetches, in one batch, every window whose
+// properties were invalidated by PropertyNotify.
+void resolvePendingChanges(Display* dpy, Window root, const AtomTable& atoms) {
+    if (g_clientListChanged) {
+        syncClientList(dpy, root, atoms);
+    }
+    std::vector<Window> stale;
+    for (const auto& [win, state] : g_windowStates) {
+        if (state.stale) {
+            stale.push_back(win);
+        }
+    }
+    trackWindows(dpy, stale, atoms);
 }
 
-void sendNetWMState(Display* dpy, Window root, Window win, AtomCache& atoms, long action, Atom first, Atom second) {
+void sendNetWMState(Display* dpy, Window root, Window win, const AtomTable& atoms, long action, Atom first, Atom second) {
     XEvent xev{};
     xev.xclient.type = ClientMessage;
     xev.xclient.serial = 0;
     xev.xclient.send_event = True;
-    xev.xclient.message_type = atoms.get("_NET_WM_STATE");
+    xev.xclient.message_type = atoms.get(AtomId::NetWmState);
     xev.xclient.window = win;
     xev.xclient.format = 32;
     xev.xclient.data.l[0] = action;
@@ -484,142 +1351,194 @@ void sendNetWMState(Display* dpy, Window root, Window win, AtomCache& atoms, lon
     XSendEvent(dpy, root, False, mask, &xev);
 }
 
-void unmaximizeWindow(Display* dpy, Window root, Window win, AtomCache& atoms) {
-    auto horz = atoms.get("_NET_WM_STATE_MAXIMIZED_HORZ");
-    auto vert = atoms.get("_NET_WM_STATE_MAXIMIZED_VERT");
+void unmaximizeWindow(Display* dpy, Window root, Window win, const AtomTable& atoms) {
+    auto horz = atoms.get(AtomId::NetWmStateMaximizedHorz);
+    auto vert = atoms.get(AtomId::NetWmStateMaximizedVert);
     sendNetWMState(dpy, root, win, atoms, 0, horz, vert); // 0 == _NET_WM_STATE_REMOVE
 }
 
-void removeDecorations(Display* dpy, Window win, AtomCache& atoms) {
+void removeDecorations(Display* dpy, Window win, const AtomTable& atoms) {
     MotifHints hints{};
     XChangeProperty(dpy,
                     win,
-                    atoms.get("_MOTIF_WM_HINTS"),
-                    atoms.get("_MOTIF_WM_HINTS"),
+                    atoms.get(AtomId::MotifWmHints),
+                    atoms.get(AtomId::MotifWmHints),
                     32,
                     PropModeReplace,
                     reinterpret_cast<unsigned char*>(&hints),
                     5);
 }
 
-struct Rect {
-    int x;
-    int y;
-    int width;
-    int height;
-};
+// ICCCM 4.1.2.3: the WM places the frame so that the reference point picked
+// by the client's win_gravity lands where the configure request says. This is
+// how far the requested position must sit from the frame's outer edge.
+int gravityOffset(int gravity, int before, int after, bool horizontal) {
+    if (gravity == StaticGravity) {
+        return before;
+    }
+    // NorthWestGravity..SouthEastGravity enumerate a 3x3 grid row by row.
+    int index = gravity - NorthWestGravity;
+    if (index < 0 || index > 8) {
+        return 0;
+    }
+    int step = horizontal ? index % 3 : index / 3;
+    return (before + after) * step / 2;
+}
 
-std::vector<int> distribute(int total, int slots) {
-    std::vector<int> result;
-    if (slots <= 0) {
-        return result;
+// Sends a configure request only when the target differs from the last rect
+// requested for this window; every configure makes the client redraw. `rect`
+// is the outer rect including the WM's frame, so the client is asked for the
+// size left inside its frame and the frame lands exactly on the cell.
+void applyGeometry(Display* dpy, Window win, const Rect& rect) {
+    auto it = g_windowStates.find(win);
+    if (it != g_windowStates.end() && it->second.requested == rect) {
+        return;
     }
-    int base = total / slots;
-    int remainder = total - base * slots;
-    for (int i = 0; i < slots; ++i) {
-        result.push_back(base + (i < remainder ? 1 : 0));
+    FrameExtents frame{};
+    int gravity = NorthWestGravity;
+    if (it != g_windowStates.end()) {
+        frame = it->second.frame;
+        if (it->second.sizeHints) {
+            gravity = it->second.sizeHints->winGravity;
+        }
+    }
+    Rect client = clientRect(rect, frame);
+    XWindowChanges changes{};
+    changes.x = rect.x + gravityOffset(gravity, frame.left, frame.right, true);
+    changes.y = rect.y + gravityOffset(gravity, frame.top, frame.bottom, false);
+    changes.width = client.width;
+    changes.height = client.height;
+    XConfigureWindow(dpy, win, CWX | CWY | CWWidth | CWHeight, &changes);
+    ++g_stats.configuresSent;
+    if (it != g_windowStates.end()) {
+        it->second.requested = rect;
     }
-    return result;
 }
 
-std::vector<int> buildRows(int count) {
-    switch (count) {
-        case 1:
-            return {1};
-        case 2:
-            return {2};
-        case 3:
-            return {3};
-        case 4:
-            return {2, 2};
-        case 5:
-            return {2, 3};
-        case 6:
-            return {3, 3};
-        default:
-            break;
+// Strips maximization and decorations from a window about to be tiled. The
+// Motif hint is written once per window and the _NET_WM_STATE message is only
+// sent while the cached state says the window is maximized.
+void prepareWindow(Display* dpy, Window root, Window win, const AtomTable& atoms) {
+    auto it = g_windowStates.find(win);
+    if (it == g_windowStates.end()) {
+        return;
+    }
+    auto& state = it->second;
+    if (state.maximized) {
+        unmaximizeWindow(dpy, root, win, atoms);
+        state.maximized = false;
     }
-    std::vector<int> rows;
-    int remaining = count;
-    while (remaining > 0) {
-        int cols = remaining >= 3 ? 3 : remaining;
-        rows.push_back(cols);
-        remaining -= cols;
+    if (!state.decorationsRemoved) {
+        removeDecorations(dpy, win, atoms);
+        state.decorationsRemoved = true;
     }
-    return rows;
 }
 
-std::vector<Rect> computePositions(int count, int screenW, int screenH, const DesktopLayout& layout) {
-    std::vector<Rect> result;
-    if (count <= 0) {
-        return result;
+void refreshWorkareas(Display* dpy, Window root, const AtomTable& atoms) {
+    g_workareas.clear();
+    auto values = getCardinalProperty(dpy, root, atoms.get(AtomId::NetWorkarea));
+    for (unsigned long i = 0; i + 4 <= values.size(); i += 4) {
+        const unsigned long* area = values.data() + i;
+        g_workareas.push_back(Rect{static_cast<int>(area[0]),
+                                   static_cast<int>(area[1]),
+                                   static_cast<int>(area[2]),
+                                   static_cast<int>(area[3])});
     }
-    auto rows = buildRows(count);
-    int usableWidth = std::max(0, screenW - layout.marginLeft - layout.marginRight);
-    int totalVertical = std::max(0, screenH - layout.marginTop - layout.marginBottom);
-    int usableHeight = totalVertical - layout.gap * static_cast<int>(rows.size() - 1);
-    if (usableHeight < 0) {
-        usableHeight = 0;
-    }
-    auto rowHeights = distribute(usableHeight, static_cast<int>(rows.size()));
-
-    int remaining = count;
-    int y = layout.marginTop;
-    for (size_t rowIdx = 0; rowIdx < rows.size() && remaining > 0; ++rowIdx) {
-        int cols = std::min(rows[rowIdx], remaining);
-        int rowWidth = usableWidth - layout.gap * (cols - 1);
-        if (rowWidth < 0) {
-            rowWidth = 0;
-        }
-        auto widths = distribute(rowWidth, cols);
-        int x = layout.marginLeft;
-        for (int width : widths) {
-            result.push_back(Rect{x, y, width, rowHeights[rowIdx]});
-            x += width + layout.gap;
-            if (--remaining == 0) {
-                break;
+}
+
+// Re-reads the monitor layout; called at startup and on RRScreenChangeNotify
+// so retiles never query it.
+void refreshOutputs(Display* dpy, [[maybe_unused]] Window root) {
+    int screen = DefaultScreen(dpy);
+    g_screenArea = Rect{0, 0, DisplayWidth(dpy, screen), DisplayHeight(dpy, screen)};
+    g_outputs.clear();
+#ifdef WMTILER_HAVE_XRANDR
+    int count = 0;
+    if (XRRMonitorInfo* monitors = XRRGetMonitors(dpy, root, True, &count)) {
+        for (int i = 0; i < count; ++i) {
+            std::string name;
+            if (monitors[i].name != None) {
+                if (char* atomName = XGetAtomName(dpy, monitors[i].name)) {
+                    name = atomName;
+                    XFree(atomName);
+                }
             }
+            g_outputs.push_back(
+                Output{name, Rect{monitors[i].x, monitors[i].y, monitors[i].width, monitors[i].height}});
         }
-        y += rowHeights[rowIdx] + layout.gap;
+        XRRFreeMonitors(monitors);
+    }
+#endif
+    if (g_outputs.empty()) {
+        g_outputs.push_back(Output{"default", g_screenArea});
     }
-    return result;
 }
 
-void applyGeometry(Display* dpy, Window win, const Rect& rect) {
-    XWindowChanges changes{};
-    changes.x = rect.x;
-    changes.y = rect.y;
-    changes.width = rect.width;
-    changes.height = rect.height;
-    XConfigureWindow(dpy, win, CWX | CWY | CWWidth | CWHeight, &changes);
+// The area an output is tiled into before its margins are applied: the
+// output clipped to the desktop's work area. WMs that publish a single work
+// area for all desktops are covered by the fallback to the first entry.
+Rect tilingArea(unsigned long desktop, size_t output, const Config& cfg) {
+    const Rect& monitor = g_outputs[output].area;
+    if (!cfg.useWorkarea || g_workareas.empty()) {
+        return monitor;
+    }
+    const Rect& work = desktop < g_workareas.size() ? g_workareas[desktop] : g_workareas.front();
+    int left = std::max(monitor.x, work.x);
+    int top = std::max(monitor.y, work.y);
+    int right = std::min(monitor.x + monitor.width, work.x + work.width);
+    int bottom = std::min(monitor.y + monitor.height, work.y + work.height);
+    if (right <= left || bottom <= top) {
+        return monitor;
+    }
+    return Rect{left, top, right - left, bottom - top};
+}
+
+DesktopLayout layoutForOutput(const Config& cfg, unsigned long desktop, size_t output) {
+    auto it = cfg.perOutput.find(g_outputs[output].name);
+    if (it != cfg.perOutput.end()) {
+        return it->second;
+    }
+    return layoutForDesktop(cfg, desktop);
 }
 
 void tileWindows(Display* dpy,
                  Window root,
                  unsigned long desktop,
-                 AtomCache& atoms,
-                 const DesktopLayout& layout) {
-    int screen = DefaultScreen(dpy);
-    int screenW = DisplayWidth(dpy, screen);
-    int screenH = DisplayHeight(dpy, screen);
-    auto windows = collectWindows(dpy, root, desktop, atoms);
-    if (windows.empty()) {
-        g_windowOrder.erase(desktop);
+                 const AtomTable& atoms,
+                 const Config& cfg) {
+    g_dirtyDesktops.erase(desktop);
+    auto& [ordered, onOutput, fitted] = g_retileBuffers;
+    orderedWindows(desktop, ordered);
+    if (ordered.empty()) {
         return;
     }
-    auto ordered = stableOrder(desktop, windows);
-    auto positions = computePositions(static_cast<int>(ordered.size()), screenW, screenH, layout);
-    for (size_t i = 0; i < ordered.size() && i < positions.size(); ++i) {
-        unmaximizeWindow(dpy, root, ordered[i], atoms);
-        removeDecorations(dpy, ordered[i], atoms);
-        applyGeometry(dpy, ordered[i], positions[i]);
+    for (size_t output = 0; output < g_outputs.size(); ++output) {
+        windowsOnOutput(ordered, output, onOutput);
+        if (onOutput.empty()) {
+            continue;
+        }
+        auto layout = layoutForOutput(cfg, desktop, output);
+        Rect screen = tilingArea(desktop, output, cfg);
+        std::span<const Rect> positions;
+        auto splits = g_desktopSplits.find({desktop, output});
+        if (splits != g_desktopSplits.end() && hasCustomWeights(splits->second, onOutput.size())) {
+            positions = splitPositions(splits->second, onOutput.size(), screen, layout);
+        } else {
+            positions = g_layoutCache.get(static_cast<int>(onOutput.size()), screen, layout);
+        }
+        fitted.resize(onOutput.size());
+        fitToSizeHints(positions, onOutput, layout.gap, fitted);
+        for (size_t i = 0; i < onOutput.size(); ++i) {
+            prepareWindow(dpy, root, onOutput[i], atoms);
+            applyGeometry(dpy, onOutput[i], fitted[i]);
+        }
     }
     XFlush(dpy);
 }
 
-std::set<unsigned long> defaultTiledDesktops(Display* dpy, Window root, AtomCache& atoms) {
+std::set<unsigned long> defaultTiledDesktops(Display* dpy, Window root, const AtomTable& atoms) {
     std::set<unsigned long> result;
-    auto total = getCardinal(dpy, root, atoms.get("_NET_NUMBER_OF_DESKTOPS"));
+    auto total = getCardinal(dpy, root, atoms.get(AtomId::NetNumberOfDesktops));
     if (!total || *total <= 1) {
         result.insert(0);
         return result;
@@ -630,14 +1549,22 @@ std::set<unsigned long> defaultTiledDesktops(Display* dpy, Window root, AtomCach
     return result;
 }
 
-unsigned long currentDesktop(Display* dpy, Window root, AtomCache& atoms) {
-    auto desktop = getCardinal(dpy, root, atoms.get("_NET_CURRENT_DESKTOP"));
+unsigned long currentDesktop(Display* dpy, Window root, const AtomTable& atoms) {
+    auto desktop = getCardinal(dpy, root, atoms.get(AtomId::NetCurrentDesktop));
     if (!desktop) {
         return 0;
     }
     return *desktop;
 }
 
+void markAllDesktopsDirty(Display* dpy, Window root, const AtomTable& atoms) {
+    auto total = getCardinal(dpy, root, atoms.get(AtomId::NetNumberOfDesktops)).value_or(1);
+    for (unsigned long desk = 0; desk < total; ++desk) {
+        g_dirtyDesktops.insert(desk);
+    }
+    g_dirtyDesktops.insert(g_currentDesktop);
+}
+
 bool shouldTile(unsigned long desktop, const Config& cfg) {
     return cfg.tiledDesktops.empty() || cfg.tiledDesktops.count(desktop) > 0;
 }
@@ -653,77 +1580,257 @@ DesktopLayout layoutForDesktop(const Config& cfg, unsigned long desktop) {
     return cfg.defaults;
 }
 
-bool moveActiveWindow(Display* dpy,
-                      Window root,
-                      unsigned long desktop,
-                      AtomCache& atoms,
-                      const Config& cfg,
-                      bool forward) {
-    auto windows = collectWindows(dpy, root, desktop, atoms);
-    if (windows.empty()) {
-        g_windowOrder.erase(desktop);
-        return false;
+// Configures the net effect of a batch. When the batch only changed one
+// slot's weight, only the windows whose rects depend on it are relaid out.
+void commitCommandBatch(Display* dpy,
+                        Window root,
+                        const AtomTable& atoms,
+                        const Config& cfg,
+                        const CommandBatch& batch) {
+    auto& splits = g_desktopSplits[{batch.desktop, batch.output}];
+    size_t count = batch.windows.size();
+    if (splits.weights.size() < count) {
+        splits.weights.resize(count, kDefaultWeight);
+    }
+    size_t changed = 0;
+    size_t slot = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (splits.weights[i] != batch.weights[i]) {
+            ++changed;
+            slot = i;
+        }
     }
-    auto ordered = stableOrder(desktop, windows);
-    auto active = getActiveWindow(dpy, root, atoms);
-    if (!active) {
-        return false;
+    if (batch.reordered || changed > 1) {
+        std::copy(batch.weights.begin(), batch.weights.end(), splits.weights.begin());
+        splits.valid = false;
+        tileWindows(dpy, root, batch.desktop, atoms, cfg);
+        return;
     }
-    auto it = std::find(ordered.begin(), ordered.end(), *active);
-    if (it == ordered.end()) {
-        return false;
+    if (changed == 0) {
+        return;
     }
-    if (forward) {
-        if (std::next(it) == ordered.end()) {
-            return false;
-        }
-        std::iter_swap(it, std::next(it));
-    } else {
-        if (it == ordered.begin()) {
-            return false;
-        }
-        std::iter_swap(it, std::prev(it));
+
+    auto layout = layoutForOutput(cfg, batch.desktop, batch.output);
+    Rect screen = tilingArea(batch.desktop, batch.output, cfg);
+    // Rects for the old weights, so relayout only has to patch one slot.
+    auto rects = splitPositions(splits, count, screen, layout);
+    splits.weights[slot] = batch.weights[slot];
+    auto [first, last] = engineFor(layout).relayout(
+        screen, layout, std::span<const int>(splits.weights.data(), count), slot, rects);
+    auto& fitted = g_retileBuffers.fitted;
+    fitted.resize(count);
+    if (fitToSizeHints(rects, batch.windows, layout.gap, fitted)) {
+        // Size-hint slack can spill past the relaid range; applyGeometry
+        // still only configures the windows whose rect changed.
+        first = 0;
+        last = count;
+    }
+    for (size_t i = first; i < last; ++i) {
+        prepareWindow(dpy, root, batch.windows[i], atoms);
+        applyGeometry(dpy, batch.windows[i], fitted[i]);
     }
-    g_windowOrder[desktop] = ordered;
-    tileWindows(dpy, root, desktop, atoms, layoutForDesktop(cfg, desktop));
-    return true;
+    XFlush(dpy);
 }
 
-void runOnce(Display* dpy, Window root, AtomCache& atoms, const Config& cfg) {
-    auto desktop = currentDesktop(dpy, root, atoms);
-    if (!shouldTile(desktop, cfg)) {
+void runOnce(Display* dpy, Window root, const AtomTable& atoms, const Config& cfg) {
+    g_currentDesktop = currentDesktop(dpy, root, atoms);
+    refreshOutputs(dpy, root);
+    refreshWorkareas(dpy, root, atoms);
+    syncClientList(dpy, root, atoms);
+    if (!shouldTile(g_currentDesktop, cfg)) {
         return;
     }
-    tileWindows(dpy, root, desktop, atoms, layoutForDesktop(cfg, desktop));
+    tileWindows(dpy, root, g_currentDesktop, atoms, cfg);
 }
 
 void handleSignal(int) {
     g_interrupted = true;
 }
 
-void processPendingCommands(Display* dpy, Window root, AtomCache& atoms, const Config& cfg) {
-    auto commands = pullCommands();
-    for (const auto& cmd : commands) {
-        auto desktop = currentDesktop(dpy, root, atoms);
-        if (!shouldTile(desktop, cfg)) {
+// Drains the queued commands into one in-memory batch, so a burst of hotkeys
+// costs one active-window lookup and one configure pass. A batch takes at
+// most a ring's worth of commands so their replies always fit the reply ring.
+void processPendingCommands(Display* dpy, Window root, const AtomTable& atoms, const Config& cfg) {
+    PendingCommand cmd;
+    if (!g_commandRing.pop(cmd)) {
+        return;
+    }
+    auto& outcomes = g_commandOutcomes;
+    auto& batch = g_commandBatch;
+    outcomes.clear();
+
+    resolvePendingChanges(dpy, root, atoms);
+    const char* unavailable = nullptr;
+    if (!shouldTile(g_currentDesktop, cfg)) {
+        unavailable = "desktop-not-tiled";
+    } else if (auto active = getActiveWindow(dpy, root, atoms);
+               !active || !beginCommandBatch(g_currentDesktop, *active, batch)) {
+        unavailable = "no-tiled-active-window";
+    } else {
+        batch.engine = layoutForOutput(cfg, g_currentDesktop, batch.output).engine;
+    }
+    do {
+        if (cmd.rejected) {
+            outcomes.push_back(CommandOutcome{cmd, cmd.rejected, -1});
             continue;
         }
-        switch (cmd.type) {
-            case CommandType::MoveLeft:
-                moveActiveWindow(dpy, root, desktop, atoms, cfg, false);
-                break;
-            case CommandType::MoveRight:
-                moveActiveWindow(dpy, root, desktop, atoms, cfg, true);
-                break;
+        if (unavailable) {
+            outcomes.push_back(CommandOutcome{cmd, unavailable, -1});
+            continue;
         }
+        bool applied = applyCommand(batch, cmd.type);
+        outcomes.push_back(CommandOutcome{cmd, applied ? nullptr : "no-effect", static_cast<long>(batch.slot)});
+    } while (outcomes.size() < kCommandRingSize && g_commandRing.pop(cmd));
+    if (g_commandRingFull.exchange(false)) {
+        signalEventFd(g_replyEventFd); // the listener resumes the clients it paused
+    }
+    if (!unavailable) {
+        commitCommandBatch(dpy, root, atoms, cfg, batch);
     }
+
+    auto done = std::chrono::steady_clock::now();
+    for (const auto& outcome : outcomes) {
+        if (outcome.command.replyFd < 0) {
+            continue;
+        }
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(done - outcome.command.received);
+        postReply(CommandReply{outcome.command.replyFd,
+                               outcome.command.connection,
+                               outcome.error,
+                               outcome.index,
+                               static_cast<long long>(latency.count())});
+    }
+}
+
+void armTimer(int timerFd, std::optional<std::chrono::steady_clock::time_point> deadline) {
+    itimerspec spec{};
+    if (deadline) {
+        auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            *deadline - std::chrono::steady_clock::now());
+        // A zero it_value disarms the timer, so an expired deadline still
+        // needs a non-zero delay.
+        auto ns = std::max<long long>(delay.count(), 1);
+        spec.it_value.tv_sec = static_cast<time_t>(ns / 1000000000);
+        spec.it_value.tv_nsec = static_cast<long>(ns % 1000000000);
+    }
+    timerfd_settime(timerFd, 0, &spec, nullptr);
 }
 
-void runDaemon(Display* dpy, Window root, AtomCache& atoms, const Config& cfg) {
+// Handles a PropertyNotify on root. Only the few properties that can change
+// a layout are considered; everything else written to root
+// (_NET_ACTIVE_WINDOW on each focus change, panel data, ...) is noise.
+// Returns true when a retile pass is needed.
+bool applyRootProperty(Display* dpy, Window root, Atom atom, const AtomTable& atoms) {
+    // _NET_CLIENT_LIST only changes when clients come and go, unlike the
+    // stacking list, which changes on every raise.
+    if (atom == atoms.get(AtomId::NetClientList)) {
+        g_clientListChanged = true;
+        return true;
+    }
+    if (atom == atoms.get(AtomId::NetCurrentDesktop)) {
+        g_currentDesktop = currentDesktop(dpy, root, atoms);
+        return g_dirtyDesktops.count(g_currentDesktop) > 0;
+    }
+    if (atom == atoms.get(AtomId::NetNumberOfDesktops) || atom == atoms.get(AtomId::NetWorkarea)) {
+        if (atom == atoms.get(AtomId::NetWorkarea)) {
+            refreshWorkareas(dpy, root, atoms);
+        }
+        markAllDesktopsDirty(dpy, root, atoms);
+        return true;
+    }
+    return false;
+}
+
+// Leading- and trailing-edge debounce for event-driven retiles. The first
+// change after a quiet period retiles immediately; changes that follow within
+// the quiet window coalesce into one trailing retile, which a continuous event
+// stream can postpone by at most maxWait.
+class RetileDebouncer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    RetileDebouncer(std::chrono::milliseconds quiet,
+                    std::chrono::milliseconds maxWait,
+                    bool leading)
+        : quiet_(quiet), maxWait_(maxWait), leading_(leading) {}
+
+    void notify(Clock::time_point now) {
+        if (leading_ && !burstStart_ && now >= quietUntil_) {
+            if (!immediate_) {
+                immediate_ = now;
+            }
+        } else if (!immediate_) {
+            if (!burstStart_) {
+                burstStart_ = now;
+            }
+            lastChange_ = now;
+        }
+        quietUntil_ = now + quiet_;
+    }
+
+    std::optional<Clock::time_point> deadline() const {
+        if (immediate_) {
+            return immediate_;
+        }
+        if (!burstStart_) {
+            return std::nullopt;
+        }
+        return std::min(lastChange_ + quiet_, *burstStart_ + maxWait_);
+    }
+
+    bool due(Clock::time_point now) const {
+        auto when = deadline();
+        return when && now >= *when;
+    }
+
+    // Called after a retile; changes caused by it coalesce into a trailing one.
+    void fired(Clock::time_point now) {
+        immediate_.reset();
+        burstStart_.reset();
+        quietUntil_ = now + quiet_;
+    }
+
+private:
+    std::chrono::milliseconds quiet_;
+    std::chrono::milliseconds maxWait_;
+    bool leading_;
+    std::optional<Clock::time_point> immediate_;
+    std::optional<Clock::time_point> burstStart_;
+    Clock::time_point lastChange_{};
+    Clock::time_point quietUntil_{};
+};
+
+void runDaemon(Display* dpy, Window root, const AtomTable& atoms, const Config& cfg) {
     XSelectInput(dpy,
                  root,
                  PropertyChangeMask | SubstructureNotifyMask | StructureNotifyMask);
-    auto schedule = std::optional<std::chrono::steady_clock::time_point>{};
+    RetileDebouncer debouncer(cfg.debounce, cfg.debounceMaxWait, cfg.leadingRetile);
+#ifdef WMTILER_HAVE_XRANDR
+    int randrEventBase = -1;
+    int randrErrorBase = 0;
+    if (XRRQueryExtension(dpy, &randrEventBase, &randrErrorBase)) {
+        XRRSelectInput(dpy, root, RRScreenChangeNotifyMask);
+    } else {
+        randrEventBase = -1;
+    }
+#endif
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    g_commandEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    g_commandStopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    g_replyEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (timerFd < 0 || g_commandEventFd < 0 || g_commandStopFd < 0 || g_replyEventFd < 0) {
+        fail("Failed to create daemon event descriptors");
+    }
+
+    // SIGINT/SIGTERM are only let through inside ppoll(), so one that
+    // arrives after the g_interrupted check still ends the wait. The listener
+    // thread inherits the blocked mask and never sees them.
+    sigset_t blocked;
+    sigset_t waitMask;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &waitMask);
 
     if (!cfg.commandSocket.empty()) {
         g_commandSocketPath = cfg.commandSocket;
@@ -737,6 +1844,8 @@ void runDaemon(Display* dpy, Window root, AtomCache& atoms, const Config& cfg) {
     }
 
     runOnce(dpy, root, atoms, cfg);
+    markAllDesktopsDirty(dpy, root, atoms);
+    g_dirtyDesktops.erase(g_currentDesktop);
 
     while (!g_interrupted) {
         processPendingCommands(dpy, root, atoms, cfg);
@@ -745,29 +1854,91 @@ void runDaemon(Display* dpy, Window root, AtomCache& atoms, const Config& cfg) {
             XNextEvent(dpy, &event);
             switch (event.type) {
                 case PropertyNotify:
-                case CreateNotify:
-                case DestroyNotify:
+                    // Both root and client windows report every property
+                    // change; only the ones that affect the layout matter.
+                    if (event.xproperty.window == root
+                            ? applyRootProperty(dpy, root, event.xproperty.atom, atoms)
+                            : applyWindowEvent(event, atoms)) {
+                        debouncer.notify(std::chrono::steady_clock::now());
+                    }
+                    break;
                 case ConfigureNotify:
-                    schedule = std::chrono::steady_clock::now() + cfg.debounce;
+                case DestroyNotify:
+                case MapNotify:
+                case UnmapNotify:
+                    // New clients are picked up from the client list, so
+                    // CreateNotify and frame events need no handling.
+                    if (applyWindowEvent(event, atoms)) {
+                        debouncer.notify(std::chrono::steady_clock::now());
+                    }
                     break;
                 default:
+#ifdef WMTILER_HAVE_XRANDR
+                    if (randrEventBase >= 0 && event.type == randrEventBase + RRScreenChangeNotify) {
+                        XRRUpdateConfiguration(&event);
+                        refreshOutputs(dpy, root);
+                        markAllDesktopsDirty(dpy, root, atoms);
+                        debouncer.notify(std::chrono::steady_clock::now());
+                    }
+#endif
                     break;
             }
         }
 
-        if (schedule && std::chrono::steady_clock::now() >= *schedule) {
-            schedule.reset();
-            auto desktop = currentDesktop(dpy, root, atoms);
-            if (shouldTile(desktop, cfg)) {
-                tileWindows(dpy, root, desktop, atoms, layoutForDesktop(cfg, desktop));
+        if (debouncer.due(std::chrono::steady_clock::now())) {
+            debouncer.fired(std::chrono::steady_clock::now());
+            resolvePendingChanges(dpy, root, atoms);
+            auto desktop = g_currentDesktop;
+            // Dirty desktops that are not visible wait until they are shown.
+            if (g_dirtyDesktops.count(desktop) > 0 && shouldTile(desktop, cfg)) {
+                tileWindows(dpy, root, desktop, atoms, cfg);
+                ++g_stats.retiles;
+                if (cfg.verbose) {
+                    std::cout << "retile #" << g_stats.retiles << " on desktop " << desktop
+                              << " (configure requests sent: " << g_stats.configuresSent
+                              << ", self-induced ConfigureNotify suppressed: "
+                              << g_stats.suppressedEchoes
+                              << ", layout cache hits: " << g_layoutCache.hits() << ")" << std::endl;
+                }
             }
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        // Round trips made while retiling may have queued new events that
+        // ppoll() would never report, so handle those before sleeping.
+        if (g_interrupted || XPending(dpy) > 0) {
+            continue;
+        }
+        armTimer(timerFd, debouncer.deadline());
+
+        pollfd fds[] = {
+            {ConnectionNumber(dpy), POLLIN, 0},
+            {timerFd, POLLIN, 0},
+            {g_commandEventFd, POLLIN, 0},
+        };
+        if (ppoll(fds, std::size(fds), nullptr, &waitMask) < 0 && errno != EINTR) {
+            std::cerr << "ppoll failed: " << std::strerror(errno) << '\n';
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            drainFd(timerFd);
+        }
+        if (fds[2].revents & POLLIN) {
+            drainFd(g_commandEventFd);
+        }
     }
 
     processPendingCommands(dpy, root, atoms, cfg);
     stopCommandServer();
+    std::cout << "wmtiler: " << g_stats.retiles << " event-driven retiles, "
+              << g_stats.configuresSent << " configure requests, "
+              << g_stats.suppressedEchoes << " self-induced ConfigureNotify suppressed, "
+              << g_layoutCache.hits() << " layout cache hits" << std::endl;
+    close(timerFd);
+    close(g_commandEventFd);
+    g_commandEventFd = -1;
+    close(g_replyEventFd);
+    g_replyEventFd = -1;
+    pthread_sigmask(SIG_SETMASK, &waitMask, nullptr);
 }
 
 std::set<unsigned long> parseDesktopList(const std::string& value) {
@@ -791,6 +1962,7 @@ std::set<unsigned long> parseDesktopList(const std::string& value) {
 void printUsage(const char* argv0) {
     std::cout << "Usage: " << argv0 << " [options]\n"
               << "  --daemon                 Run in background and watch X11 events\n"
+              << "  --verbose                Log every event-driven retile (daemon mode)\n"
               << "  --tile-desktops 1,2,3    Comma-separated list of desktops to tile\n"
               << "  --margin-x <px>          Default horizontal margin applied to both sides\n"
               << "  --margin-left <px>       Default left margin\n"
@@ -798,11 +1970,20 @@ void printUsage(const char* argv0) {
               << "  --margin-top <px>        Default top margin\n"
               << "  --margin-bottom <px>     Default bottom margin\n"
               << "  --gap <px>               Default gap between windows\n"
-              << "  --desktop-config N:top,right,bottom,left,gap      Per-desktop override\n"
-              << "  --desktop-default-config top,right,bottom,left,gap Default for tiled desktops\n"
+              << "  --desktop-config N:top,right,bottom,left,gap[,engine]      Per-desktop override\n"
+              << "  --desktop-default-config top,right,bottom,left,gap[,engine] Default for tiled desktops\n"
+              << "                           engine: grid (default), grid-balanced, master-stack or dwindle\n"
+              << "  --output-config NAME:top,right,bottom,left,gap[,engine] Per-monitor override (XRandR name)\n"
+              << "  --debounce <ms>          Quiet period that coalesces event bursts (default 200)\n"
+              << "  --debounce-max-wait <ms> Longest a burst can postpone a retile (default 1000)\n"
+              << "  --no-leading-retile      Wait for the quiet period before the first retile\n"
+              << "  --ignore-workarea        Tile the whole screen instead of _NET_WORKAREA\n"
               << "  --command-socket <path>  Path to the UNIX socket (default /tmp/wmtiler.sock)\n"
               << "  --move-left              Send \"move-left\" command to a running daemon\n"
               << "  --move-right             Send \"move-right\" command to a running daemon\n"
+              << "  --grow                   Send \"grow\" command: enlarge the active window's split\n"
+              << "  --shrink                 Send \"shrink\" command: reduce the active window's split\n"
+              << "  --reply                  With a command: wait for and print the daemon's answer\n"
               << "  --help                   Show this message\n";
 }
 
@@ -833,8 +2014,16 @@ DesktopLayout parseLayoutSpec(const std::string& spec) {
             throw std::runtime_error("Invalid value in desktop config: " + token);
         }
     }
-    if (idx != 5 || std::getline(ss, token, ',')) {
-        throw std::runtime_error("Layout spec must contain 5 integers: top,right,bottom,left,gap");
+    if (idx != 5) {
+        throw std::runtime_error(
+            "Layout spec must contain 5 integers: top,right,bottom,left,gap[,engine]");
+    }
+    if (std::getline(ss, token, ',')) {
+        auto engine = parseLayoutEngine(token);
+        if (!engine || std::getline(ss, token, ',')) {
+            throw std::runtime_error("Unknown layout engine in desktop config: " + token);
+        }
+        layout.engine = *engine;
     }
     layout.marginTop = values[0];
     layout.marginRight = values[1];
@@ -850,6 +2039,8 @@ Config parseArgs(int argc, char** argv) {
         std::string arg = argv[i];
         if (arg == "--daemon") {
             cfg.daemon = true;
+        } else if (arg == "--verbose") {
+            cfg.verbose = true;
         } else if (arg == "--tile-desktops") {
             if (i + 1 >= argc) {
                 fail("--tile-desktops expects a comma-separated list");
@@ -884,10 +2075,26 @@ Config parseArgs(int argc, char** argv) {
             }
         } else if (arg == "--desktop-default-config") {
             if (i + 1 >= argc) {
-                fail("--desktop-default-config expects top,right,bottom,left,gap");
+                fail("--desktop-default-config expects top,right,bottom,left,gap[,engine]");
             }
             cfg.tiledDefaults = parseLayoutSpec(argv[++i]);
             cfg.hasTiledDefaults = true;
+        } else if (arg == "--debounce") {
+            int value = 0;
+            if (i + 1 >= argc || !parseIntArg(argv[++i], value) || value < 0) {
+                fail("Invalid value for --debounce");
+            }
+            cfg.debounce = std::chrono::milliseconds(value);
+        } else if (arg == "--debounce-max-wait") {
+            int value = 0;
+            if (i + 1 >= argc || !parseIntArg(argv[++i], value) || value < 0) {
+                fail("Invalid value for --debounce-max-wait");
+            }
+            cfg.debounceMaxWait = std::chrono::milliseconds(value);
+        } else if (arg == "--ignore-workarea") {
+            cfg.useWorkarea = false;
+        } else if (arg == "--no-leading-retile") {
+            cfg.leadingRetile = false;
         } else if (arg == "--command-socket") {
             if (i + 1 >= argc) {
                 fail("--command-socket expects a path");
@@ -899,19 +2106,37 @@ Config parseArgs(int argc, char** argv) {
         } else if (arg == "--move-right") {
             cfg.sendCommand = true;
             cfg.commandToSend = "move-right";
+        } else if (arg == "--reply") {
+            cfg.waitForReply = true;
+        } else if (arg == "--grow") {
+            cfg.sendCommand = true;
+            cfg.commandToSend = "grow";
+        } else if (arg == "--shrink") {
+            cfg.sendCommand = true;
+            cfg.commandToSend = "shrink";
         } else if (arg == "--desktop-config") {
             if (i + 1 >= argc) {
-                fail("--desktop-config expects N:top,right,bottom,left,gap");
+                fail("--desktop-config expects N:top,right,bottom,left,gap[,engine]");
             }
             std::string value = argv[++i];
             auto colon = value.find(':');
             if (colon == std::string::npos) {
-                fail("Format for --desktop-config is N:top,right,bottom,left,gap");
+                fail("Format for --desktop-config is N:top,right,bottom,left,gap[,engine]");
             }
             auto deskStr = value.substr(0, colon);
             auto layoutStr = value.substr(colon + 1);
             unsigned long desk = std::stoul(deskStr);
             cfg.perDesktop[desk] = parseLayoutSpec(layoutStr);
+        } else if (arg == "--output-config") {
+            if (i + 1 >= argc) {
+                fail("--output-config expects NAME:top,right,bottom,left,gap[,engine]");
+            }
+            std::string value = argv[++i];
+            auto colon = value.find(':');
+            if (colon == std::string::npos || colon == 0) {
+                fail("Format for --output-config is NAME:top,right,bottom,left,gap[,engine]");
+            }
+            cfg.perOutput[value.substr(0, colon)] = parseLayoutSpec(value.substr(colon + 1));
         } else if (arg == "--help" || arg == "-h") {
             printUsage(argv[0]);
             std::exit(0);
@@ -929,6 +2154,9 @@ Config parseArgs(int argc, char** argv) {
 int main(int argc, char** argv) {
     try {
         Config cfg = parseArgs(argc, argv);
+        if (cfg.waitForReply && !cfg.sendCommand) {
+            fail("--reply only applies to --move-*, --grow and --shrink");
+        }
         if (cfg.sendCommand) {
             if (cfg.daemon) {
                 fail("Cannot use --daemon together with --move-* commands");
@@ -939,7 +2167,11 @@ int main(int argc, char** argv) {
         if (!g_display) {
             fail("Failed to connect to X server. Is DISPLAY set?");
         }
-        AtomCache atoms(g_display);
+        XSetErrorHandler(handleXError);
+        // Xlib's own connection: batched XCB requests stay ordered with the
+        // Xlib requests around them, and the display owns its lifetime.
+        g_xcb = XGetXCBConnection(g_display);
+        AtomTable atoms(g_display);
         Window root = DefaultRootWindow(g_display);
         if (cfg.tiledDesktops.empty()) {
             cfg.tiledDesktops = defaultTiledDesktops(g_display, root, atoms);
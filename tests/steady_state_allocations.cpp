@@ -0,0 +1,128 @@
+// Drives the X-free half of a retile and of a command batch with every
+// global operator new counted, and fails if a pass after the warm-up
+// allocates.
+#include "tiling.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+namespace {
+
+// Global operator new calls made by this thread.
+thread_local unsigned long g_allocationCount = 0;
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    ++g_allocationCount;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+using namespace wmtiler;
+
+constexpr unsigned long kDesktop = 1;
+constexpr size_t kWindowCount = 6;
+constexpr int kPasses = 100;
+
+// Storage a pass reuses, as the daemon reuses its own between retiles.
+std::vector<Window> g_ordered;
+CommandBatch g_batch;
+
+// Six tileable windows on one output; every other one is a terminal-like
+// client with size increments and a frame, so fitToSizeHints has work to do.
+void addWindows() {
+    g_outputs.push_back(Output{"", Rect{0, 0, 1920, 1080}});
+    for (size_t i = 0; i < kWindowCount; ++i) {
+        Window win = 0x100 + i;
+        auto& state = g_windowStates[win];
+        state.desktop = kDesktop;
+        state.mapped = true;
+        state.listed = true;
+        if (i % 2 == 0) {
+            SizeHints hints;
+            hints.minWidth = hints.baseWidth = 20;
+            hints.minHeight = hints.baseHeight = 10;
+            hints.widthInc = 7;
+            hints.heightInc = 13;
+            state.sizeHints = hints;
+            state.frame = FrameExtents{1, 1, 20, 1};
+        }
+        g_desktopClients[kDesktop].push_back(win);
+    }
+}
+
+// One steady-state pass. Every command sequence is undone by its mirror, so
+// each pass starts from the same state as the one before.
+bool exercise() {
+    const Rect screen{0, 0, 1920, 1080};
+    orderedWindows(kDesktop, g_ordered);
+
+    std::array<Rect, kWindowCount> rects{};
+    std::array<Rect, kWindowCount> fitted{};
+    const std::array<int, kWindowCount> weights{100, 140, 60, 100, 200, 80};
+    for (const auto& engine : kLayoutEngines) {
+        DesktopLayout layout;
+        layout.marginTop = layout.marginRight = layout.marginBottom = layout.marginLeft = 6;
+        layout.gap = 6;
+        layout.engine = engine.engine;
+        for (int count : {1, 3, static_cast<int>(kWindowCount)}) {
+            g_layoutCache.get(count, screen, layout);
+        }
+        fitToSizeHints(g_layoutCache.get(static_cast<int>(kWindowCount), screen, layout),
+                       g_ordered, layout.gap, fitted);
+
+        engine.compute(screen, layout, weights, rects);
+        engine.relayout(screen, layout, weights, 2, rects);
+
+        auto& splits = g_desktopSplits[{kDesktop, static_cast<size_t>(engine.engine)}];
+        splits.weights.assign(weights.begin(), weights.end());
+        fitToSizeHints(splitPositions(splits, kWindowCount, screen, layout), g_ordered, layout.gap, fitted);
+    }
+
+    if (!beginCommandBatch(kDesktop, g_ordered.front(), g_batch)) {
+        return false;
+    }
+    g_batch.engine = LayoutEngine::Grid;
+    for (size_t i = 0; i + 1 < kWindowCount; ++i) {
+        applyCommand(g_batch, CommandType::MoveRight);
+    }
+    applyCommand(g_batch, CommandType::Grow);
+    applyCommand(g_batch, CommandType::Shrink);
+    for (size_t i = 0; i + 1 < kWindowCount; ++i) {
+        applyCommand(g_batch, CommandType::MoveLeft);
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    addWindows();
+    if (!exercise()) {
+        std::cerr << "the first window did not start a command batch\n";
+        return 1;
+    }
+    auto before = g_allocationCount;
+    for (int pass = 0; pass < kPasses; ++pass) {
+        exercise();
+    }
+    if (g_allocationCount != before) {
+        std::cerr << "steady-state passes allocated " << g_allocationCount - before << " times\n";
+        return 1;
+    }
+    return 0;
+}